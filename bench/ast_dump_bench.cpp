@@ -0,0 +1,173 @@
+/*
+ * Benchmark for dumping the parse tree
+ * Times print_pre_order against the buffered dump_tree in every format on
+ * a large generated program, and checks the text output is identical
+*/
+
+#include <iostream>
+#include <chrono>
+#include <cstdlib>
+#include <fstream>
+#include <sstream>
+#include <string>
+
+#include "parser.h"
+#include "tree_traversal.h"
+
+// Blocks nest FAN_OUT wide and LEVELS deep so statement chains stay short
+const unsigned int FAN_OUT = 4;
+const unsigned int LEVELS = 6;
+const unsigned int STATS_PER_BLOCK = 12;
+
+void generate_block(std::string &source, unsigned int level) {
+  source += "start\n";
+
+  if (level == LEVELS) {
+    for (unsigned int s = 0; s < STATS_PER_BLOCK; s++) {
+      switch (s % 3) {
+        case 0:
+          source += "assign a = a + " + std::to_string(s) + " * ( b - 1 ) ;\n";
+          break;
+        case 1:
+          source += "talk . a / 2 + b ;\n";
+          break;
+        default:
+          source += "if [ a > b ] then assign b = a - 1 ; else assign b = b + 1 ; ;\n";
+      }
+    }
+  }
+  else {
+    for (unsigned int i = 0; i < FAN_OUT; i++) {
+      generate_block(source, level + 1);
+    }
+  }
+
+  source += "stop\n";
+}
+
+std::string generate_program() {
+  std::string source = "declare a = 1 ;\ndeclare b = 2 ;\nprogram\n";
+  generate_block(source, 0);
+
+  return source;
+}
+
+// Counts and hashes what is written without keeping it
+class Digest_Buffer : public std::streambuf {
+  public:
+    unsigned long long size = 0;
+    unsigned long long hash = 14695981039346656037ULL;
+
+  protected:
+    int_type overflow(int_type c) override {
+      if (c != traits_type::eof()) {
+        add(static_cast<char>(c));
+      }
+
+      return c;
+    }
+
+    std::streamsize xsputn(const char *text, std::streamsize count) override {
+      for (std::streamsize i = 0; i < count; i++) {
+        add(text[i]);
+      }
+
+      return count;
+    }
+
+  private:
+    void add(char c) {
+      size++;
+      hash = (hash ^ static_cast<unsigned char>(c)) * 1099511628211ULL;
+    }
+};
+
+double elapsed_ms(std::chrono::steady_clock::time_point start) {
+  return std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count();
+}
+
+unsigned int count_nodes(const Node *root) {
+  unsigned int count = 1;
+
+  for (const Node *child: root->children) {
+    if (child != nullptr) {
+      count += count_nodes(child);
+    }
+  }
+
+  return count;
+}
+
+// Old recursive printer, it only writes to std::cout
+double time_print_pre_order(Node *root, std::ostream &out) {
+  std::streambuf *saved = std::cout.rdbuf(out.rdbuf());
+
+  auto start = std::chrono::steady_clock::now();
+  print_pre_order(root);
+  double ms = elapsed_ms(start);
+
+  std::cout.rdbuf(saved);
+  return ms;
+}
+
+double time_dump_tree(Node *root, Ast_Format format, std::ostream &out) {
+  auto start = std::chrono::steady_clock::now();
+  dump_tree(root, format, out);
+  return elapsed_ms(start);
+}
+
+int main() {
+  std::string source = generate_program();
+  std::istringstream source_fp(source);
+  Node *root = parser(source_fp);
+
+  if (root == nullptr) {
+    std::cout << "Generated program did not parse" << std::endl;
+    return EXIT_FAILURE;
+  }
+
+  std::cout << "Source bytes: " << source.size() << ", nodes: " << count_nodes(root) << std::endl;
+
+  // Text dump must match the old printer byte for byte
+  Digest_Buffer old_digest;
+  Digest_Buffer new_digest;
+  std::ostream old_text(&old_digest);
+  std::ostream new_text(&new_digest);
+  time_print_pre_order(root, old_text);
+  time_dump_tree(root, AST_TEXT, new_text);
+
+  if (old_digest.size != new_digest.size || old_digest.hash != new_digest.hash) {
+    std::cout << "Text dump differs from print_pre_order" << std::endl;
+    return EXIT_FAILURE;
+  }
+
+  std::cout << "Text bytes: " << old_digest.size << "\n" << std::endl;
+
+  // Write to a real file so per line flushes cost what they do in use
+  std::ofstream sink("/dev/null");
+
+  double old_ms = time_print_pre_order(root, sink);
+  std::cout << "print_pre_order: " << old_ms << " ms, "
+    << old_digest.size / 1048576.0 / (old_ms / 1000.0) << " MB/s" << std::endl;
+
+  const char *names[] = { "", "text", "json", "dot" };
+
+  for (Ast_Format format: { AST_TEXT, AST_JSON, AST_DOT }) {
+    Digest_Buffer digest;
+    std::ostream measured(&digest);
+    dump_tree(root, format, measured);
+
+    double ms = time_dump_tree(root, format, sink);
+
+    std::cout << "dump_tree " << names[format] << ": " << ms << " ms, "
+      << digest.size / 1048576.0 / (ms / 1000.0) << " MB/s";
+
+    if (format == AST_TEXT) {
+      std::cout << ", " << old_ms / ms << "x print_pre_order";
+    }
+
+    std::cout << std::endl;
+  }
+
+  return 0;
+}
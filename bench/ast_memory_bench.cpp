@@ -0,0 +1,120 @@
+/*
+ * Benchmark for parse tree memory
+ * Parses a large generated program and reports the heap the finished tree
+ * holds per node, along with parse time
+*/
+
+#include <iostream>
+#include <chrono>
+#include <cstdlib>
+#include <map>
+#include <new>
+#include <sstream>
+#include <string>
+
+#include "parser.h"
+
+const unsigned int GROUPS = 2000;
+
+// Live heap, every block carries its size in front of it
+const size_t HEADER = 16;
+long long live_bytes = 0;
+unsigned long long live_blocks = 0;
+
+void *operator new(size_t size) {
+  char *memory = static_cast<char *>(std::malloc(size + HEADER));
+  if (memory == nullptr) { throw std::bad_alloc(); }
+
+  *reinterpret_cast<size_t *>(memory) = size;
+  live_bytes += size;
+  live_blocks++;
+
+  return memory + HEADER;
+}
+
+void operator delete(void *memory) noexcept {
+  if (memory == nullptr) { return; }
+
+  char *block = static_cast<char *>(memory) - HEADER;
+  live_bytes -= *reinterpret_cast<size_t *>(block);
+  live_blocks--;
+
+  std::free(block);
+}
+
+void operator delete(void *memory, size_t) noexcept {
+  operator delete(memory);
+}
+
+// Every statement kind, with scopes, labels and long names
+std::string generate_program() {
+  std::string source = "declare total = 0 ;\ndeclare step = 3 ;\nprogram\nstart\n";
+
+  for (unsigned int g = 0; g < GROUPS; g++) {
+    std::string n = std::to_string(g);
+
+    source += "  start\n    declare counter = " + n + " ;\n";
+    source += "    listen counter ;\n";
+    source += "    assign total = total + counter * ( step - 1 ) / 2 ;\n";
+    source += "    if [ total > 1000 ] then assign total = . total ; else talk total ; ;\n";
+    source += "    while [ counter {==} 0 ] start assign counter = counter - 1 ; stop ;\n";
+    source += "    label skip" + n + " ;\n";
+    source += "    if [ counter % step ] then jump skip" + n + " ; ;\n";
+    source += "  stop\n";
+  }
+
+  return source + "stop\n";
+}
+
+// Node count by label
+void count_nodes(const Node *node, std::map<std::string, unsigned int> &counts) {
+  counts[node->func_label]++;
+
+  for (const Node *child: node->children) {
+    if (child != nullptr) {
+      count_nodes(child, counts);
+    }
+  }
+}
+
+int main() {
+  std::string source = generate_program();
+  std::istringstream source_fp(source);
+
+  long long bytes_before = live_bytes;
+  unsigned long long blocks_before = live_blocks;
+  auto start = std::chrono::steady_clock::now();
+
+  Node *root = parser(source_fp);
+
+  double ms = std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count();
+  long long tree_bytes = live_bytes - bytes_before;
+  unsigned long long tree_blocks = live_blocks - blocks_before;
+
+  if (root == nullptr) {
+    std::cout << "Generated program did not parse" << std::endl;
+    return EXIT_FAILURE;
+  }
+
+  std::map<std::string, unsigned int> counts;
+  count_nodes(root, counts);
+
+  unsigned int nodes = 0;
+  for (auto &entry: counts) {
+    nodes += entry.second;
+  }
+
+  std::cout << "Source bytes: " << source.size() << ", nodes: " << nodes << std::endl;
+
+  for (auto &entry: counts) {
+    std::cout << "  " << entry.first << ": " << entry.second << std::endl;
+  }
+
+  std::cout << "\nsizeof(Node): " << sizeof(Node) << " bytes" << std::endl;
+  std::cout << "Tree heap: " << tree_bytes << " bytes in " << tree_blocks << " blocks" << std::endl;
+  std::cout << "Per node: " << static_cast<double>(tree_bytes) / nodes << " bytes, "
+    << static_cast<double>(tree_blocks) / nodes << " blocks" << std::endl;
+  std::cout << "Parse: " << ms << " ms" << std::endl;
+
+  return 0;
+}
@@ -0,0 +1,232 @@
+/*
+ * Benchmark for the quality of generated code
+ * Compiles the corpus in bench/corpus/ and reports for each program its
+ * instruction count, storage written by write_global_vars() and the
+ * instructions executed on the reference executor, after checking its
+ * output against the golden output next to it
+ *
+ * --save=FILE keeps the numbers, --compare=FILE reports them as before -> after,
+ * so a code generation change can be measured against the tree it started from
+*/
+
+#include <iostream>
+#include <iomanip>
+#include <fstream>
+#include <map>
+#include <sstream>
+#include <string>
+#include <vector>
+
+#include "executor.h"
+#include "optimizer.h"
+#include "parser.h"
+#include "runtime_semantics.h"
+
+const unsigned long long STEP_LIMIT = 10000000;
+const std::string CORPUS_DIR = "bench/corpus/";
+
+// Corpus programs and the input each one reads
+// Output expected for that input is in <name>.golden, one value per line
+struct Program {
+  std::string name;
+  std::vector<long long> input;
+};
+
+std::vector<Program> programs = {
+  { "counting_loops", { 12 } },
+  { "grade_ladder", { 8, 95, 100, 83, 71, 64, 12, 59, 80 } },
+  { "state_machine", { 6, 7, 27, 1, 0 } },
+  { "talk_heavy", {} },
+  { "primes", { 100 } },
+  { "gcd", { 48, 18, -35, 14, 17, 5, 0 } }
+};
+
+// What the generated code of a program costs
+struct Quality {
+  unsigned int size;
+  unsigned int storage;
+  unsigned long long executed;
+
+  Quality() {
+    this->size = 0;
+    this->storage = 0;
+    this->executed = 0;
+  }
+};
+
+std::string read_file(const std::string &filename) {
+  std::ifstream in_fp(filename);
+  std::stringstream contents;
+  contents << in_fp.rdbuf();
+
+  return contents.str();
+}
+
+std::vector<long long> read_golden(const std::string &filename) {
+  std::ifstream in_fp(filename);
+  std::vector<long long> values;
+  long long value;
+
+  while (in_fp >> value) {
+    values.push_back(value);
+  }
+
+  return values;
+}
+
+// Compile and run a program, false with a message if it does not match its golden output
+bool measure(const Program &program, Quality &quality) {
+  std::string source = read_file(CORPUS_DIR + program.name + ".fl2021");
+
+  if (source.empty()) {
+    std::cout << program.name << ": missing from " << CORPUS_DIR << std::endl;
+    return false;
+  }
+
+  std::istringstream source_fp(source);
+  Node *root = parser(source_fp);
+
+  optimize_tree(root);
+  initialize_semantics(root);
+
+  const std::vector<std::string> &lines = get_asm_lines();
+
+  // Program lines, then storage after the blank line
+  while (quality.size < lines.size() && !lines[quality.size].empty()) {
+    quality.size++;
+  }
+
+  quality.storage = (quality.size < lines.size()) ? lines.size() - quality.size - 1 : 0;
+
+  Exec_Result result = execute_asm(lines, program.input, STEP_LIMIT);
+  quality.executed = result.executed;
+
+  if (!result.finished) {
+    std::cout << program.name << ": " << result.error << std::endl;
+    return false;
+  }
+
+  if (result.output != read_golden(CORPUS_DIR + program.name + ".golden")) {
+    std::cout << program.name << ": output differs from its golden output" << std::endl;
+    return false;
+  }
+
+  return true;
+}
+
+// "name size storage executed" per line
+std::map<std::string, Quality> load_results(const std::string &filename) {
+  std::ifstream in_fp(filename);
+  std::map<std::string, Quality> results;
+
+  std::string name;
+  Quality quality;
+
+  while (in_fp >> name >> quality.size >> quality.storage >> quality.executed) {
+    results[name] = quality;
+  }
+
+  return results;
+}
+
+// Column of a number, with where it was before when there is one
+std::string column(unsigned long long before, unsigned long long after, bool has_before) {
+  if (!has_before) {
+    return std::to_string(after);
+  }
+
+  return std::to_string(before) + " -> " + std::to_string(after);
+}
+
+int main(int argc, char *argv[]) {
+  std::string save_file;
+  std::string compare_file;
+
+  for (int i = 1; i < argc; i++) {
+    std::string arg = argv[i];
+
+    if (arg.compare(0, 7, "--save=") == 0) {
+      save_file = arg.substr(7);
+    }
+    else if (arg.compare(0, 10, "--compare=") == 0) {
+      compare_file = arg.substr(10);
+    }
+    else {
+      std::cout << "Usage: codegen_quality_bench [--save=FILE] [--compare=FILE]" << std::endl;
+      return EXIT_FAILURE;
+    }
+  }
+
+  std::map<std::string, Quality> baseline;
+
+  if (!compare_file.empty()) {
+    baseline = load_results(compare_file);
+
+    if (baseline.empty()) {
+      std::cout << "No results to compare against in " << compare_file << std::endl;
+      return EXIT_FAILURE;
+    }
+  }
+
+  std::cout << std::left << std::setw(18) << "program" << std::setw(16) << "size"
+    << std::setw(16) << "storage" << "executed" << std::endl;
+
+  std::vector<std::pair<std::string, Quality>> results;
+  Quality total;
+  Quality total_before;
+  bool compared = !baseline.empty();
+
+  for (const Program &program: programs) {
+    Quality quality;
+
+    if (!measure(program, quality)) {
+      return EXIT_FAILURE;
+    }
+
+    results.push_back(std::make_pair(program.name, quality));
+
+    auto found = baseline.find(program.name);
+    const Quality *before = (found == baseline.end()) ? nullptr : &found->second;
+
+    // Totals only compare programs measured both times
+    compared = compared && before != nullptr;
+
+    if (before != nullptr) {
+      total_before.size += before->size;
+      total_before.storage += before->storage;
+      total_before.executed += before->executed;
+    }
+
+    total.size += quality.size;
+    total.storage += quality.storage;
+    total.executed += quality.executed;
+
+    Quality shown = before ? *before : Quality();
+
+    std::cout << std::setw(18) << program.name
+      << std::setw(16) << column(shown.size, quality.size, before != nullptr)
+      << std::setw(16) << column(shown.storage, quality.storage, before != nullptr)
+      << column(shown.executed, quality.executed, before != nullptr) << std::endl;
+  }
+
+  std::cout << "\n" << std::setw(18) << "total"
+    << std::setw(16) << column(total_before.size, total.size, compared)
+    << std::setw(16) << column(total_before.storage, total.storage, compared)
+    << column(total_before.executed, total.executed, compared) << std::endl;
+
+  if (compared) {
+    std::cout << "\nExecuted: " << std::fixed << std::setprecision(2)
+      << 100.0 * ((double) total.executed - total_before.executed) / total_before.executed << "% change" << std::endl;
+  }
+
+  if (!save_file.empty()) {
+    std::ofstream out_fp(save_file);
+
+    for (auto &result: results) {
+      out_fp << result.first << " " << result.second.size << " "
+        << result.second.storage << " " << result.second.executed << "\n";
+    }
+  }
+
+  return 0;
+}
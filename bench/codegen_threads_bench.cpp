@@ -0,0 +1,101 @@
+/*
+ * Benchmark for parallel code generation
+ * Parses and optimizes a large generated program once, then times code
+ * generation of its top level statements on growing thread counts and
+ * checks every output is identical to generating in order
+*/
+
+#include <iostream>
+#include <algorithm>
+#include <chrono>
+#include <cstdlib>
+#include <sstream>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include "optimizer.h"
+#include "parallel_codegen.h"
+#include "parser.h"
+#include "runtime_semantics.h"
+
+const unsigned int GROUPS = 1000;
+const unsigned int THREAD_COUNTS[] = { 1, 2, 4, 8 };
+const unsigned int RUNS = 5;
+
+// Top level blocks with unrolled loops, branches and shared expressions
+// Every 50th group jumps, so a few statements are generated in order
+std::string generate_program() {
+  std::string source = "declare total = 0 ;\ndeclare step = 3 ;\nprogram\nstart\n";
+
+  for (unsigned int g = 0; g < GROUPS; g++) {
+    std::string n = std::to_string(g);
+
+    source += "  start\n    declare c = " + std::to_string(g % 7) + " ;\n";
+    source += "    declare i = 0 ;\n";
+    source += "    while [ i < 12 ] start assign total = total + c * ( step - 1 ) / 2 ; assign i = i + 1 ; stop ;\n";
+    source += "    if [ total > 100000 ] then assign total = total - 100000 ; else talk total * step + c ; ;\n";
+    source += "    while [ c > 0 ] start assign c = c - 1 ; talk c * step + total ; stop ;\n";
+    source += "  stop\n";
+
+    if (g % 50 == 49) {
+      source += "  label s" + n + " ;\n";
+      source += "  if [ total < 0 ] then jump s" + n + " ; ;\n";
+    }
+  }
+
+  return source + "stop\n";
+}
+
+double elapsed_ms(std::chrono::steady_clock::time_point start) {
+  return std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count();
+}
+
+int main() {
+  std::istringstream source_fp(generate_program());
+
+  Node *root = parser(source_fp);
+  optimize_tree(root);
+
+  // Threads only run side by side with as many cores
+  std::cout << "Groups: " << GROUPS << ", hardware threads: " << std::thread::hardware_concurrency() << std::endl;
+
+  initialize_semantics(root);
+  std::vector<std::string> serial_lines = get_asm_lines();
+
+  std::cout << "Lines: " << serial_lines.size() << "\n" << std::endl;
+
+  for (unsigned int threads: THREAD_COUNTS) {
+    std::vector<double> times;
+
+    for (unsigned int r = 0; r < RUNS; r++) {
+      auto start = std::chrono::steady_clock::now();
+
+      if (threads == 1) {
+        initialize_semantics(root);
+      }
+      else {
+        parallel_semantics(root, threads);
+      }
+
+      times.push_back(elapsed_ms(start));
+
+      if (get_asm_lines() != serial_lines) {
+        std::cout << threads << " threads gave different code" << std::endl;
+        return EXIT_FAILURE;
+      }
+    }
+
+    std::sort(times.begin(), times.end());
+
+    std::cout << "  " << threads << " threads: " << times[RUNS / 2] << " ms";
+
+    if (threads > 1) {
+      std::cout << ", " << get_parallel_parts() << " parts, " << get_serial_stats() << " statements in order";
+    }
+
+    std::cout << std::endl;
+  }
+
+  return 0;
+}
@@ -0,0 +1,183 @@
+/*
+ * Benchmark for the compiler library (src/compfs.h)
+ * Compiles the corpus in bench/corpus/ and a set of sources with errors through
+ * compile() on growing thread counts at once, reporting compiles per second,
+ * and checks every result is the one a single compile gives and that errors
+ * come back as diagnostics instead of ending the process
+*/
+
+#include <iostream>
+#include <atomic>
+#include <chrono>
+#include <cstdlib>
+#include <fstream>
+#include <sstream>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include "compfs.h"
+
+const unsigned int THREAD_COUNTS[] = { 1, 2, 4 };
+const unsigned int ROUNDS = 20;
+const std::string CORPUS_DIR = "bench/corpus/";
+
+const char *CORPUS[] = { "counting_loops", "grade_ladder", "state_machine", "talk_heavy", "primes", "gcd" };
+
+// Each one ends its compile in a different stage
+struct Error_Source {
+  const char *name;
+  Diagnostic_Kind kind;
+  std::string source;
+};
+
+std::vector<Error_Source> error_sources = {
+  { "scanner", SCANNER_ERROR, "program\nstart\n talk 1 @ ;\nstop\n" },
+  { "parser", PARSER_ERROR, "program\nstart\n talk ;\nstop\n" },
+  { "undeclared", SEMANTIC_ERROR, "program\nstart\n talk x ;\nstop\n" },
+  { "redeclared", SEMANTIC_ERROR, "declare x = 1 ;\ndeclare x = 2 ;\nprogram\nstart\n talk x ;\nstop\n" },
+  { "empty", PARSER_ERROR, "" }
+};
+
+struct Job {
+  std::string name;
+  std::string source;
+  Compile_Options options;
+  Compile_Result expected;
+};
+
+std::string read_file(const std::string &filename) {
+  std::ifstream in_fp(filename);
+  std::stringstream contents;
+  contents << in_fp.rdbuf();
+
+  return contents.str();
+}
+
+bool same_result(const Compile_Result &a, const Compile_Result &b) {
+  if (a.succeeded != b.succeeded || a.assembly != b.assembly || a.source_map != b.source_map
+      || a.listing != b.listing || a.diagnostics.size() != b.diagnostics.size()) {
+    return false;
+  }
+
+  for (unsigned int i = 0; i < a.diagnostics.size(); i++) {
+    if (a.diagnostics[i].kind != b.diagnostics[i].kind || a.diagnostics[i].message != b.diagnostics[i].message) {
+      return false;
+    }
+  }
+
+  return true;
+}
+
+Compile_Result compile_job(const Job &job) {
+  return compile(job.source.data(), job.source.size(), job.options);
+}
+
+// Every job ROUNDS times shared out over the threads, false if any result differed
+bool run_jobs(const std::vector<Job> &jobs, unsigned int threads) {
+  std::atomic<unsigned int> next_job(0);
+  std::atomic<bool> matched(true);
+
+  auto work = [&]() {
+    unsigned int j;
+
+    while ((j = next_job++) < jobs.size() * ROUNDS) {
+      const Job &job = jobs[j % jobs.size()];
+
+      if (!same_result(compile_job(job), job.expected)) {
+        matched = false;
+      }
+    }
+  };
+
+  std::vector<std::thread> workers;
+
+  for (unsigned int t = 0; t < threads; t++) {
+    workers.push_back(std::thread(work));
+  }
+
+  for (std::thread &worker: workers) {
+    worker.join();
+  }
+
+  return matched;
+}
+
+int main() {
+  std::vector<Job> jobs;
+
+  // The corpus under the default options, then with the options that change the stages
+  for (const char *name: CORPUS) {
+    Job job;
+    job.name = name;
+    job.source = read_file(CORPUS_DIR + name + ".fl2021");
+
+    if (job.source.empty()) {
+      std::cout << name << ": missing from " << CORPUS_DIR << std::endl;
+      return EXIT_FAILURE;
+    }
+
+    jobs.push_back(job);
+
+    job.options.codegen_threads = 2;
+    job.options.source_map = true;
+    jobs.push_back(job);
+
+    job.options = Compile_Options();
+    job.options.via_ir = true;
+    job.options.dump_ir = true;
+    jobs.push_back(job);
+
+    job.options = Compile_Options();
+    job.options.scan_thread = true;
+    job.options.dump_ast = AST_JSON;
+    jobs.push_back(job);
+  }
+
+  for (const Error_Source &error: error_sources) {
+    Job job;
+    job.name = error.name;
+    job.source = error.source;
+
+    jobs.push_back(job);
+  }
+
+  // A single compile of each gives the result every later one must match
+  for (Job &job: jobs) {
+    job.expected = compile_job(job);
+
+    if (job.expected.succeeded == job.expected.assembly.empty()) {
+      std::cout << job.name << ": compiled without assembly, or failed with it" << std::endl;
+      return EXIT_FAILURE;
+    }
+  }
+
+  for (unsigned int i = 0; i < error_sources.size(); i++) {
+    const Compile_Result &result = jobs[jobs.size() - error_sources.size() + i].expected;
+
+    if (result.succeeded || result.diagnostics.empty() || result.diagnostics[0].kind != error_sources[i].kind) {
+      std::cout << error_sources[i].name << ": error did not come back as its diagnostic" << std::endl;
+      return EXIT_FAILURE;
+    }
+  }
+
+  // Threads only run side by side with as many cores
+  std::cout << "Jobs: " << jobs.size() << " (" << error_sources.size() << " with errors), hardware threads: "
+    << std::thread::hardware_concurrency() << "\n" << std::endl;
+
+  for (unsigned int threads: THREAD_COUNTS) {
+    auto start = std::chrono::steady_clock::now();
+
+    if (!run_jobs(jobs, threads)) {
+      std::cout << threads << " threads gave a different result" << std::endl;
+      return EXIT_FAILURE;
+    }
+
+    double ms = std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count();
+
+    std::cout << "  " << threads << " threads: " << ms << " ms, "
+      << jobs.size() * ROUNDS / (ms / 1000) << " compiles/s" << std::endl;
+  }
+
+  return 0;
+}
@@ -0,0 +1,166 @@
+/*
+ * Benchmark for incremental recompilation
+ * Builds a ~100k line program, then times single line edits against
+ * full recompiles and checks the assembly against compile() of the whole
+ * source with the tree passes off, which the incremental path matches
+ * Also reports how much larger that code is than a default compile
+*/
+
+#include <iostream>
+#include <algorithm>
+#include <chrono>
+#include <cstdlib>
+#include <string>
+#include <vector>
+
+#include "compfs.h"
+#include "incremental.h"
+
+const unsigned int GROUPS = 1000;
+const unsigned int UNITS_PER_GROUP = 12;
+const unsigned int EDITS = 200;
+const unsigned int VERIFY_EVERY = 50;
+
+// Lines of the generated program and where its talk statements are
+std::vector<std::string> lines;
+std::vector<unsigned int> talk_lines;
+
+// Each group is a nested block of about 100 lines
+void generate_program() {
+  lines.push_back("declare a = 1 ;");
+  lines.push_back("declare b = 2 ;");
+  lines.push_back("program");
+  lines.push_back("start");
+  lines.push_back("  declare c = 0 ;");
+
+  for (unsigned int g = 0; g < GROUPS; g++) {
+    lines.push_back("  start");
+    lines.push_back("    declare d = " + std::to_string(g) + " ;");
+
+    for (unsigned int u = 0; u < UNITS_PER_GROUP; u++) {
+      talk_lines.push_back(lines.size() + 1);
+      lines.push_back("    talk a + " + std::to_string(u) + " ;");
+      lines.push_back("    assign c = c + b * 2 ;");
+      lines.push_back("    if [ c > 100 ] then");
+      lines.push_back("      assign c = 0 ;");
+      lines.push_back("    ;");
+      lines.push_back("    while [ d < 3 ] start");
+      lines.push_back("      assign d = d + 1 ;");
+      lines.push_back("    stop ;");
+    }
+
+    lines.push_back("  stop");
+  }
+
+  lines.push_back("stop");
+}
+
+std::string join_lines() {
+  std::string source;
+
+  for (const std::string &line: lines) {
+    source += line + "\n";
+  }
+
+  return source;
+}
+
+// Assembly of a whole compile of the current lines
+std::string compile_lines(bool tree_passes) {
+  std::string source = join_lines();
+
+  Compile_Options options;
+  options.tree_passes = tree_passes;
+
+  return compile(source.data(), source.size(), options).assembly;
+}
+
+// Instructions before the storage section
+unsigned int program_size(const std::string &assembly) {
+  size_t end = assembly.find("\n\n");
+  std::string program = assembly.substr(0, end);
+
+  return std::count(program.begin(), program.end(), '\n') + 1;
+}
+
+double elapsed_ms(std::chrono::steady_clock::time_point start) {
+  return std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count();
+}
+
+int main() {
+  generate_program();
+
+  std::cout << "Source lines: " << lines.size() << std::endl;
+
+  auto start = std::chrono::steady_clock::now();
+  incremental_load(join_lines());
+  double full_ms = elapsed_ms(start);
+
+  std::cout << "Full compile: " << full_ms << " ms" << std::endl;
+
+  srand(4280);
+
+  double edit_total_ms = 0;
+  double insert_total_ms = 0;
+  unsigned int reused = 0;
+  unsigned int generated = 0;
+  unsigned int full_reparses = 0;
+
+  for (unsigned int i = 0; i < EDITS; i++) {
+    // Change the literal on one talk line
+    unsigned int line = talk_lines[rand() % talk_lines.size()];
+    std::vector<std::string> replacement(1, "    talk a + " + std::to_string(rand() % 1000) + " ;");
+    lines[line - 1] = replacement[0];
+
+    start = std::chrono::steady_clock::now();
+    Incremental_Stats stats = incremental_edit(line, line, replacement);
+    edit_total_ms += elapsed_ms(start);
+
+    reused += stats.reused_chunks;
+    generated += stats.generated_chunks;
+    full_reparses += stats.full_reparse ? 1 : 0;
+
+    if (i % VERIFY_EVERY == 0) {
+      if (incremental_output() != compile_lines(false)) {
+        std::cout << "Mismatch against full compile after edit " << i << std::endl;
+        return EXIT_FAILURE;
+      }
+    }
+  }
+
+  // Inserting a line moves everything below it
+  for (unsigned int i = 0; i < EDITS / 10; i++) {
+    unsigned int line = talk_lines[rand() % talk_lines.size()];
+    std::vector<std::string> inserted(1, "    talk b ;");
+    lines.insert(lines.begin() + (line - 1), inserted[0]);
+
+    for (unsigned int &talk_line: talk_lines) {
+      if (talk_line >= line) { talk_line++; }
+    }
+
+    start = std::chrono::steady_clock::now();
+    Incremental_Stats stats = incremental_edit(line, line - 1, inserted);
+    insert_total_ms += elapsed_ms(start);
+
+    full_reparses += stats.full_reparse ? 1 : 0;
+  }
+
+  std::string incremental = incremental_output();
+
+  if (incremental != compile_lines(false)) {
+    std::cout << "Mismatch against full compile after insertions" << std::endl;
+    return EXIT_FAILURE;
+  }
+
+  std::cout << "Single line edit: " << edit_total_ms / EDITS << " ms average over " << EDITS << std::endl;
+  std::cout << "Line insertion: " << insert_total_ms / (EDITS / 10) << " ms average over " << EDITS / 10 << std::endl;
+  std::cout << "Chunks reused/generated per edit: " << reused / EDITS << "/" << generated / EDITS << std::endl;
+  std::cout << "Full reparses: " << full_reparses << std::endl;
+  std::cout << "Speedup: " << full_ms / (edit_total_ms / EDITS) << "x" << std::endl;
+
+  // Tree passes are left out of the incremental path, see incremental.h
+  std::cout << "Program size: " << program_size(incremental) << " incremental, "
+    << program_size(compile_lines(true)) << " with the tree passes" << std::endl;
+
+  return 0;
+}
@@ -0,0 +1,145 @@
+/*
+ * Benchmark for the three address IR
+ * Times every phase on a large generated program next to direct code
+ * generation, and checks both backends agree on the test programs
+*/
+
+#include <iostream>
+#include <chrono>
+#include <cstdlib>
+#include <fstream>
+#include <sstream>
+#include <string>
+#include <vector>
+
+#include "executor.h"
+#include "ir.h"
+#include "optimizer.h"
+#include "parser.h"
+#include "runtime_semantics.h"
+
+const unsigned int GROUPS = 200;
+const unsigned long long STEP_LIMIT = 10000000;
+
+// Test programs and the input each one reads
+struct Check {
+  std::string file;
+  std::vector<long long> input;
+};
+
+std::vector<Check> checks = {
+  { "test_files/P4/p4p5.fl2021", { 12 } },
+  { "test_files/P4/if_else.fl2021", { 10 } },
+  { "test_files/P4/dead_code.fl2021", { 4, 5 } },
+  { "test_files/P4/loop_invariant.fl2021", { 3, 5, 2, 0 } },
+  { "test_files/P4/unroll.fl2021", { 9 } },
+  { "test_files/P4/common_subexpr.fl2021", { 5, 2 } },
+  { "test_files/P4/forward_jump.fl2021", {} }
+};
+
+// Each group is a nested block with branches, loops and labels
+std::string generate_program() {
+  std::string source = "declare a = 1 ;\ndeclare b = 2 ;\nprogram\nstart\n  declare c = 0 ;\n";
+
+  for (unsigned int g = 0; g < GROUPS; g++) {
+    source += "  start\n    declare d = " + std::to_string(g) + " ;\n";
+
+    for (unsigned int u = 0; u < 12; u++) {
+      source += "    talk a + " + std::to_string(u) + " * b ;\n";
+      source += "    assign c = c + b * 2 - d / 3 ;\n";
+      source += "    if [ c > 100 ] then assign c = 0 ; else assign c = c - 1 ; ;\n";
+      source += "    while [ d < 3 ] start assign d = d + 1 ; stop ;\n";
+    }
+
+    source += "    label l" + std::to_string(g) + " ;\n";
+    source += "    assign d = d - 1 ;\n";
+    source += "    if [ d > 5000 ] then jump l" + std::to_string(g) + " ; ;\n";
+    source += "  stop\n";
+  }
+
+  return source + "stop\n";
+}
+
+double elapsed_ms(std::chrono::steady_clock::time_point start) {
+  return std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count();
+}
+
+// Time one phase and print it
+template <typename Phase>
+double time_phase(const std::string &name, Phase phase) {
+  auto start = std::chrono::steady_clock::now();
+  phase();
+  double ms = elapsed_ms(start);
+
+  std::cout << "  " << name << ": " << ms << " ms" << std::endl;
+  return ms;
+}
+
+Node *parse_source(const std::string &text) {
+  std::istringstream source(text);
+  return parser(source);
+}
+
+int main() {
+  // Both backends must agree on every test program
+  for (const Check &check: checks) {
+    std::ifstream file(check.file);
+    std::stringstream text;
+    text << file.rdbuf();
+
+    Node *root = parse_source(text.str());
+    optimize_tree(root);
+
+    initialize_semantics(root);
+    Exec_Result direct = execute_asm(get_asm_lines(), check.input, STEP_LIMIT);
+
+    IR_Function function;
+    build_ir(root, function);
+    remove_unreachable(function);
+    remove_dead_assignments(function);
+    lower_ir(function);
+    Exec_Result via_ir = execute_asm(get_asm_lines(), check.input, STEP_LIMIT);
+
+    if (direct.output != via_ir.output || direct.error != via_ir.error) {
+      std::cout << "Backends disagree on " << check.file << std::endl;
+      return EXIT_FAILURE;
+    }
+
+    std::cout << check.file << ": " << direct.executed << " direct, "
+      << via_ir.executed << " through the IR" << std::endl;
+  }
+
+  std::string source = generate_program();
+  std::cout << "\nSource bytes: " << source.size() << std::endl;
+
+  Node *root = nullptr;
+  IR_Function function;
+  Reaching_Defs reaching;
+
+  double front = 0;
+  double direct = 0;
+  double ir_total = 0;
+
+  std::cout << "Front end" << std::endl;
+  front += time_phase("parse", [&]() { root = parse_source(source); });
+  front += time_phase("tree passes", [&]() { optimize_tree(root); });
+
+  std::cout << "Direct code generation" << std::endl;
+  direct += time_phase("codegen", [&]() { initialize_semantics(root); });
+
+  std::cout << "Through the IR" << std::endl;
+  ir_total += time_phase("build IR and CFG", [&]() { build_ir(root, function); });
+  ir_total += time_phase("remove unreachable", [&]() { remove_unreachable(function); });
+  ir_total += time_phase("dead assignments", [&]() { remove_dead_assignments(function); });
+  ir_total += time_phase("lower to assembly", [&]() { lower_ir(function); });
+
+  // Only --dump-ir runs these on their own
+  std::cout << "Analyses for --dump-ir" << std::endl;
+  time_phase("liveness", [&]() { compute_liveness(function); });
+  time_phase("reaching definitions", [&]() { reaching = compute_reaching_defs(function); });
+
+  std::cout << "\nBlocks: " << function.blocks.size() << ", definitions: " << reaching.defs.size() << std::endl;
+  std::cout << "Front end " << front << " ms, direct " << direct << " ms, IR " << ir_total << " ms" << std::endl;
+
+  return 0;
+}
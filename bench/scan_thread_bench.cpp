@@ -0,0 +1,152 @@
+/*
+ * Benchmark for the pipelined scanner
+ * Writes large generated programs to disk and parses them one top level
+ * statement at a time, with the scanner interleaved on the parser's thread
+ * and on its own thread, reporting throughput and the latency to the first
+ * token, and checks both hand the parser the same tokens
+*/
+
+#include <iostream>
+#include <algorithm>
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <fstream>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include "options.h"
+#include "parser.h"
+
+const unsigned int GROUP_COUNTS[] = { 5000, 20000, 80000 };
+const unsigned int RUNS = 3;
+const char *SOURCE_FILE = "scan_thread_bench.fl2021";
+
+// Every token the parser consumed, folded into one value
+unsigned long long token_hash = 0;
+unsigned long long token_count = 0;
+
+std::chrono::steady_clock::time_point start;
+double first_token_ms = 0;
+
+void hash_token(Node *, const Token &tk) {
+  if (token_count == 0) {
+    first_token_ms = std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count();
+  }
+
+  token_count++;
+  token_hash = token_hash * 31 + tk.token_ID * 7 + tk.line_num;
+
+  for (char c: tk.token_instance) {
+    token_hash = token_hash * 131 + c;
+  }
+}
+
+// Flat top level blocks with every statement kind and some comments
+std::string generate_program(unsigned int groups) {
+  std::string source = "declare total = 0 ;\ndeclare step = 3 ;\nprogram\nstart\n";
+
+  for (unsigned int g = 0; g < groups; g++) {
+    std::string n = std::to_string(g % 1000);
+
+    source += "  start\n    declare c" + n + " = " + std::to_string(g) + " ; && counter &&\n";
+    source += "    listen c" + n + " ;\n";
+    source += "    assign total = total + c" + n + " * ( step - 1 ) / 2 ;\n";
+    source += "    if [ total > 1000 ] then assign total = . total ; else talk total ; ;\n";
+    source += "    while [ c" + n + " {==} 0 ] start assign c" + n + " = c" + n + " - 1 ; stop ;\n";
+    source += "    label s" + n + " ;\n";
+    source += "  stop\n";
+  }
+
+  return source + "stop\n";
+}
+
+void free_tree(Node *node) {
+  if (node == nullptr) { return; }
+
+  for (Node *child: node->children) {
+    free_tree(child);
+  }
+
+  delete node;
+}
+
+// Parse the file a statement at a time, freeing each, milliseconds taken
+double parse_file(bool scan_thread) {
+  compile_options.scan_thread = scan_thread;
+  token_hash = 0;
+  token_count = 0;
+
+  std::ifstream source_fp(SOURCE_FILE);
+  start = std::chrono::steady_clock::now();
+
+  Node *root = parse_program_head(source_fp);
+  Node *stat;
+
+  while ((stat = parse_next_statement()) != nullptr) {
+    free_tree(stat);
+  }
+
+  parse_program_end();
+
+  double ms = std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count();
+  free_tree(root);
+
+  return ms;
+}
+
+int main() {
+  set_token_hook(hash_token);
+
+  // The scanner thread can only run alongside the parser with a second core
+  std::cout << "Hardware threads: " << std::thread::hardware_concurrency() << "\n" << std::endl;
+
+  for (unsigned int groups: GROUP_COUNTS) {
+    std::string source = generate_program(groups);
+    double megabytes = source.size() / (1024.0 * 1024.0);
+
+    std::ofstream out_fp(SOURCE_FILE);
+    out_fp << source;
+    out_fp.close();
+
+    std::cout << "Groups: " << groups << ", source: " << megabytes << " MB" << std::endl;
+
+    unsigned long long hashes[2];
+    unsigned long long counts[2];
+
+    for (int mode = 0; mode < 2; mode++) {
+      std::vector<double> times;
+      std::vector<double> firsts;
+
+      // Median of the runs, the first also warms the page cache
+      for (unsigned int r = 0; r < RUNS; r++) {
+        times.push_back(parse_file(mode == 1));
+        firsts.push_back(first_token_ms);
+      }
+
+      std::sort(times.begin(), times.end());
+      std::sort(firsts.begin(), firsts.end());
+
+      hashes[mode] = token_hash;
+      counts[mode] = token_count;
+
+      std::cout << "  " << (mode == 0 ? "interleaved" : "scan thread") << ": "
+        << times[RUNS / 2] << " ms, " << megabytes / (times[RUNS / 2] / 1000) << " MB/s, "
+        << token_count / times[RUNS / 2] / 1000 << " M tokens/s, first token after "
+        << firsts[RUNS / 2] << " ms" << std::endl;
+    }
+
+    if (hashes[0] != hashes[1] || counts[0] != counts[1]) {
+      std::cout << "Scan thread handed the parser different tokens" << std::endl;
+      std::remove(SOURCE_FILE);
+      return EXIT_FAILURE;
+    }
+
+    std::cout << std::endl;
+  }
+
+  std::remove(SOURCE_FILE);
+
+  return 0;
+}
@@ -0,0 +1,110 @@
+/*
+ * Benchmark for expression instruction selection
+ * Compiles the test programs with the pattern selector and with the old
+ * one template lowering, and compares code size and executed instructions
+*/
+
+#include <iostream>
+#include <iomanip>
+#include <fstream>
+#include <sstream>
+#include <string>
+#include <vector>
+
+#include "executor.h"
+#include "optimizer.h"
+#include "options.h"
+#include "parser.h"
+#include "runtime_semantics.h"
+
+const unsigned long long STEP_LIMIT = 10000000;
+
+// Test programs and the input each one reads
+struct Program {
+  std::string file;
+  std::vector<long long> input;
+};
+
+std::vector<Program> programs = {
+  { "test_files/P4/p4p1.fl2021", { 7 } },
+  { "test_files/P4/p4p3.fl2021", { 3, 1, 0 } },
+  { "test_files/P4/p4p4.fl2021", { 4 } },
+  { "test_files/P4/p4p5.fl2021", { 12 } },
+  { "test_files/P4/p4p6.fl2021", {} },
+  { "test_files/P4/if_else.fl2021", { 10 } },
+  { "test_files/P4/if_else_unary.fl2021", { -3, 4 } },
+  { "test_files/P4/dead_code.fl2021", { 4, 5 } },
+  { "test_files/P4/loop_invariant.fl2021", { 3, 5, 2, 0 } },
+  { "test_files/P4/unroll.fl2021", { 9 } },
+  { "test_files/P4/common_subexpr.fl2021", { 5, 2 } }
+};
+
+// Instructions before the storage section
+unsigned int code_size(const std::vector<std::string> &asm_lines) {
+  unsigned int size = 0;
+
+  while (size < asm_lines.size() && !asm_lines[size].empty()) {
+    size++;
+  }
+
+  return size;
+}
+
+// Compile a program and run it, false if it did not finish
+bool compile_and_run(const std::string &text, const Program &program, unsigned int &size, Exec_Result &result) {
+  std::istringstream source(text);
+  Node *root = parser(source);
+
+  optimize_tree(root);
+  initialize_semantics(root);
+
+  size = code_size(get_asm_lines());
+  result = execute_asm(get_asm_lines(), program.input, STEP_LIMIT);
+
+  return result.finished;
+}
+
+int main() {
+  std::cout << std::left << std::setw(40) << "program" << std::setw(16) << "size"
+    << std::setw(16) << "executed" << "speedup" << std::endl;
+
+  unsigned long long total_template = 0;
+  unsigned long long total_selected = 0;
+
+  for (const Program &program: programs) {
+    std::ifstream file(program.file);
+    std::stringstream text;
+    text << file.rdbuf();
+
+    unsigned int template_size = 0;
+    unsigned int selected_size = 0;
+    Exec_Result template_result;
+    Exec_Result selected_result;
+
+    compile_options.select_patterns = false;
+    bool template_ran = compile_and_run(text.str(), program, template_size, template_result);
+
+    compile_options.select_patterns = true;
+    bool selected_ran = compile_and_run(text.str(), program, selected_size, selected_result);
+
+    // Division by zero ends a program early, both must end the same way
+    if (template_ran != selected_ran || template_result.output != selected_result.output
+        || template_result.error != selected_result.error) {
+      std::cout << program.file << ": output differs with instruction selection" << std::endl;
+      return EXIT_FAILURE;
+    }
+
+    total_template += template_result.executed;
+    total_selected += selected_result.executed;
+
+    std::cout << std::setw(40) << program.file
+      << std::setw(16) << std::to_string(template_size) + " -> " + std::to_string(selected_size)
+      << std::setw(16) << std::to_string(template_result.executed) + " -> " + std::to_string(selected_result.executed)
+      << std::fixed << std::setprecision(2) << (double) template_result.executed / selected_result.executed
+      << "x" << std::endl;
+  }
+
+  std::cout << "\nExecuted in total: " << total_template << " -> " << total_selected << std::endl;
+
+  return 0;
+}
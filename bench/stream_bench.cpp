@@ -0,0 +1,177 @@
+/*
+ * Benchmark for streaming compilation
+ * Compiles generated programs of growing length with the whole tree and
+ * one top level statement at a time, reporting peak heap and time for both,
+ * and checks both outputs run the same on the reference executor
+*/
+
+#include <iostream>
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <fstream>
+#include <new>
+#include <sstream>
+#include <string>
+#include <vector>
+
+#include "executor.h"
+#include "optimizer.h"
+#include "parser.h"
+#include "runtime_semantics.h"
+#include "stream.h"
+
+// Both ways up to WHOLE_LIMIT groups, past it the whole tree overflows the default stack
+const unsigned int GROUP_COUNTS[] = { 250, 500, 1000, 4000, 16000 };
+const unsigned int WHOLE_LIMIT = 1000;
+const unsigned long long STEP_LIMIT = 100000000;
+const char *STREAM_OUTPUT = "stream_bench.asm";
+
+// Live and peak heap, every block carries its size in front of it
+const size_t HEADER = 16;
+long long live_bytes = 0;
+long long peak_bytes = 0;
+
+void *operator new(size_t size) {
+  char *memory = static_cast<char *>(std::malloc(size + HEADER));
+  if (memory == nullptr) { throw std::bad_alloc(); }
+
+  *reinterpret_cast<size_t *>(memory) = size;
+  live_bytes += size;
+
+  if (live_bytes > peak_bytes) {
+    peak_bytes = live_bytes;
+  }
+
+  return memory + HEADER;
+}
+
+void operator delete(void *memory) noexcept {
+  if (memory == nullptr) { return; }
+
+  char *block = static_cast<char *>(memory) - HEADER;
+  live_bytes -= *reinterpret_cast<size_t *>(block);
+
+  std::free(block);
+}
+
+void operator delete(void *memory, size_t) noexcept {
+  operator delete(memory);
+}
+
+// Nested blocks with locals, loops, branches and forward jumps
+std::string generate_program(unsigned int groups) {
+  std::string source = "declare total = 0 ;\nprogram\nstart\n";
+
+  for (unsigned int g = 0; g < groups; g++) {
+    std::string n = std::to_string(g);
+
+    source += "  start\n    declare c = " + std::to_string(g % 5) + " ;\n";
+    source += "    while [ c > 0 ] start assign total = total + c * 2 ; assign c = c - 1 ; stop ;\n";
+    source += "    if [ total > 100000 ] then assign total = total - 100000 ; ;\n";
+    source += "    if [ c < 1 ] then jump s" + n + " ; ;\n";
+    source += "    talk c ;\n";
+    source += "    label s" + n + " ;\n";
+    source += "  stop\n";
+
+    if (g % 100 == 99) {
+      source += "  talk total ;\n";
+    }
+  }
+
+  return source + "stop\n";
+}
+
+double elapsed_ms(std::chrono::steady_clock::time_point start) {
+  return std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count();
+}
+
+void report(const std::string &name, long long base, double ms) {
+  std::cout << "  " << name << ": peak heap " << (peak_bytes - base) << " bytes, "
+    << ms << " ms" << std::endl;
+}
+
+void free_tree(Node *node) {
+  if (node == nullptr) { return; }
+
+  for (Node *child: node->children) {
+    free_tree(child);
+  }
+
+  delete node;
+}
+
+// Run one statement at a time into a file, and read the file back
+std::vector<std::string> compile_streamed(const std::string &source) {
+  std::istringstream stream_fp(source);
+  long long base = live_bytes;
+  peak_bytes = live_bytes;
+  auto start = std::chrono::steady_clock::now();
+
+  stream_compile(stream_fp, STREAM_OUTPUT);
+
+  report("streamed", base, elapsed_ms(start));
+
+  std::vector<std::string> lines;
+  std::ifstream stream_in(STREAM_OUTPUT);
+
+  for (std::string line; std::getline(stream_in, line); ) {
+    lines.push_back(line);
+  }
+
+  std::remove(STREAM_OUTPUT);
+
+  return lines;
+}
+
+// Whole tree, code kept in the line buffer
+std::vector<std::string> compile_whole(const std::string &source) {
+  std::istringstream whole_fp(source);
+  long long base = live_bytes;
+  peak_bytes = live_bytes;
+  auto start = std::chrono::steady_clock::now();
+
+  Node *root = parser(whole_fp);
+  optimize_tree(root);
+  initialize_semantics(root);
+
+  report("whole tree", base, elapsed_ms(start));
+
+  // Give everything back so the next run starts from the same heap
+  std::vector<std::string> lines;
+  lines.swap(get_asm_lines());
+  free_tree(root);
+
+  return lines;
+}
+
+int main() {
+  for (unsigned int groups: GROUP_COUNTS) {
+    std::string source = generate_program(groups);
+    std::cout << "Groups: " << groups << ", source bytes: " << source.size() << std::endl;
+
+    std::vector<std::string> stream_lines = compile_streamed(source);
+    Exec_Result stream_run = execute_asm(stream_lines, {}, STEP_LIMIT);
+
+    if (!stream_run.finished) {
+      std::cout << "Streamed output did not run: " << stream_run.error << std::endl;
+      return EXIT_FAILURE;
+    }
+
+    if (groups <= WHOLE_LIMIT) {
+      std::vector<std::string> whole_lines = compile_whole(source);
+      Exec_Result whole_run = execute_asm(whole_lines, {}, STEP_LIMIT);
+
+      if (whole_run.output != stream_run.output) {
+        std::cout << "Streamed output differs from the whole tree" << std::endl;
+        return EXIT_FAILURE;
+      }
+
+      std::cout << "  executed " << whole_run.executed << " whole, " << stream_run.executed << " streamed" << std::endl;
+    }
+
+    std::cout << std::endl;
+  }
+
+  return 0;
+}
@@ -0,0 +1,129 @@
+/*
+ * Benchmark for counted loop unrolling
+ * Compiles a few loop kernels under each unroll budget and reports the
+ * code size and executed instruction count on the reference executor
+*/
+
+#include <iostream>
+#include <iomanip>
+#include <sstream>
+#include <string>
+#include <vector>
+
+#include "executor.h"
+#include "optimizer.h"
+#include "options.h"
+#include "parser.h"
+#include "runtime_semantics.h"
+
+const unsigned long long STEP_LIMIT = 100000000;
+
+const unsigned int BUDGETS[] = { 0, 8, 16, 32, 64, 128, 256, 1024 };
+
+struct Kernel {
+  std::string name;
+  std::string source;
+};
+
+// Loops of the counted form at different trip counts and body sizes
+std::vector<Kernel> kernels = {
+  { "sum_100",
+    "declare i = 0 ;\n"
+    "declare s = 0 ;\n"
+    "program\n"
+    "start\n"
+    "  while [ i < 100 ] start\n"
+    "    assign s = s + i ;\n"
+    "    assign i = i + 1 ;\n"
+    "  stop ;\n"
+    "  talk s ;\n"
+    "stop\n" },
+  { "countdown_30",
+    "declare i = 90 ;\n"
+    "program\n"
+    "start\n"
+    "  while [ 0 < i ] start\n"
+    "    talk i * 2 - 1 ;\n"
+    "    assign i = i - 3 ;\n"
+    "  stop ;\n"
+    "stop\n" },
+  { "nested_10x10",
+    "declare i = 0 ;\n"
+    "declare s = 0 ;\n"
+    "program\n"
+    "start\n"
+    "  while [ i < 10 ] start\n"
+    "    declare j = 0 ;\n"
+    "    while [ j < 10 ] start\n"
+    "      assign s = s + i * j ;\n"
+    "      assign j = j + 1 ;\n"
+    "    stop ;\n"
+    "    assign i = i + 1 ;\n"
+    "  stop ;\n"
+    "  talk s ;\n"
+    "stop\n" },
+  { "stride_7",
+    "declare i = 3 ;\n"
+    "declare s = 0 ;\n"
+    "program\n"
+    "start\n"
+    "  while [ i < 500 ] start\n"
+    "    assign s = s + i / 7 - . i ;\n"
+    "    assign i = i + 7 ;\n"
+    "  stop ;\n"
+    "  talk s ;\n"
+    "stop\n" }
+};
+
+// Instructions before the storage section
+unsigned int code_size(const std::vector<std::string> &asm_lines) {
+  unsigned int size = 0;
+
+  while (size < asm_lines.size() && !asm_lines[size].empty()) {
+    size++;
+  }
+
+  return size;
+}
+
+int main() {
+  std::cout << std::left << std::setw(14) << "kernel" << std::setw(8) << "budget"
+    << std::setw(8) << "size" << std::setw(10) << "executed" << "speedup" << std::endl;
+
+  for (const Kernel &kernel: kernels) {
+    unsigned long long baseline = 0;
+    std::vector<long long> expected;
+
+    for (unsigned int budget: BUDGETS) {
+      compile_options.unroll_budget = budget;
+
+      std::istringstream source(kernel.source);
+      Node *root = parser(source);
+
+      optimize_tree(root);
+      initialize_semantics(root);
+
+      Exec_Result result = execute_asm(get_asm_lines(), {}, STEP_LIMIT);
+
+      if (!result.finished) {
+        std::cout << kernel.name << ": " << result.error << std::endl;
+        return EXIT_FAILURE;
+      }
+
+      if (budget == 0) {
+        baseline = result.executed;
+        expected = result.output;
+      }
+      else if (result.output != expected) {
+        std::cout << kernel.name << ": output differs at budget " << budget << std::endl;
+        return EXIT_FAILURE;
+      }
+
+      std::cout << std::setw(14) << kernel.name << std::setw(8) << budget
+        << std::setw(8) << code_size(get_asm_lines()) << std::setw(10) << result.executed
+        << std::fixed << std::setprecision(2) << (double) baseline / result.executed << "x" << std::endl;
+    }
+  }
+
+  return 0;
+}
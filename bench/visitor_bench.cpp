@@ -0,0 +1,156 @@
+/*
+ * Benchmark for the tree visitor
+ * Counts heap allocations and time per traversal of a large generated tree,
+ * walking it the old way with child lists passed by value and through
+ * Tree_Visitor in both of its modes
+*/
+
+#include <iostream>
+#include <chrono>
+#include <cstdlib>
+#include <fstream>
+#include <new>
+#include <sstream>
+#include <string>
+#include <vector>
+
+#include "parser.h"
+#include "tree_traversal.h"
+#include "tree_visitor.h"
+
+const unsigned int GROUPS = 400;
+const unsigned int STATS_PER_GROUP = 30;
+
+// Every operator new in the process goes through here
+unsigned long long allocations = 0;
+
+void *operator new(size_t size) {
+  allocations++;
+
+  void *memory = std::malloc(size == 0 ? 1 : size);
+  if (memory == nullptr) { throw std::bad_alloc(); }
+
+  return memory;
+}
+
+void operator delete(void *memory) noexcept {
+  std::free(memory);
+}
+
+void operator delete(void *memory, size_t) noexcept {
+  std::free(memory);
+}
+
+std::string generate_program() {
+  std::string source = "declare a = 1 ;\ndeclare b = 2 ;\nprogram\nstart\n";
+
+  for (unsigned int g = 0; g < GROUPS; g++) {
+    source += "  start\n";
+
+    for (unsigned int s = 0; s < STATS_PER_GROUP; s++) {
+      source += "    assign a = a + " + std::to_string(s) + " * ( b - 1 ) ;\n";
+      source += "    if [ a > b ] then talk . a / 2 ; else assign b = b + 1 ; ;\n";
+    }
+
+    source += "  stop\n";
+  }
+
+  return source + "stop\n";
+}
+
+// How iterate_children used to walk, a copy of every child list
+unsigned int copy_walk(std::vector<Node *> children) {
+  unsigned int count = 0;
+
+  for (auto child: children) {
+    if (child != nullptr) {
+      count += 1 + copy_walk(child->children);
+    }
+  }
+
+  return count;
+}
+
+struct Count_Visitor : public Tree_Visitor<Count_Visitor> {
+  unsigned int count = 0;
+
+  bool pre_visit(Node *) {
+    count++;
+    return true;
+  }
+};
+
+// Allocations and time of one traversal
+template <typename Walk>
+void measure(const std::string &name, unsigned int nodes, Walk walk) {
+  unsigned long long before = allocations;
+  auto start = std::chrono::steady_clock::now();
+
+  unsigned int visited = walk();
+
+  double ms = std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count();
+  unsigned long long made = allocations - before;
+
+  std::cout << "  " << name << ": " << made << " allocations ("
+    << static_cast<double>(made) / nodes << " per node), " << ms << " ms";
+
+  if (visited != nodes) {
+    std::cout << ", visited " << visited << " of " << nodes;
+  }
+
+  std::cout << std::endl;
+}
+
+int main() {
+  std::string source = generate_program();
+  std::istringstream source_fp(source);
+  Node *root = parser(source_fp);
+
+  if (root == nullptr) {
+    std::cout << "Generated program did not parse" << std::endl;
+    return EXIT_FAILURE;
+  }
+
+  Count_Visitor counter;
+  counter.visit(root);
+  unsigned int nodes = counter.count;
+
+  std::cout << "Nodes: " << nodes << "\n" << std::endl;
+
+  std::cout << "Walks" << std::endl;
+  measure("child lists by value", nodes, [&]() { return 1 + copy_walk(root->children); });
+
+  measure("visitor, recursive", nodes, [&]() {
+    Count_Visitor visitor;
+    visitor.visit(root);
+    return visitor.count;
+  });
+
+  // The stack is grown on the first walk and reused after
+  Count_Visitor iterative;
+  iterative.visit_iterative(root);
+
+  measure("visitor, iterative", nodes, [&]() {
+    iterative.count = 0;
+    iterative.visit_iterative(root);
+    return iterative.count;
+  });
+
+  // Printing to a sink, stdout is pointed at it for print_pre_order
+  std::ofstream sink("/dev/null");
+
+  std::cout << "Printers" << std::endl;
+  measure("print_pre_order", nodes, [&]() {
+    std::streambuf *saved = std::cout.rdbuf(sink.rdbuf());
+    print_pre_order(root);
+    std::cout.rdbuf(saved);
+    return nodes;
+  });
+
+  measure("dump_tree text", nodes, [&]() {
+    dump_tree(root, AST_TEXT, sink);
+    return nodes;
+  });
+
+  return 0;
+}
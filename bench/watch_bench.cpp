@@ -0,0 +1,114 @@
+/*
+ * Benchmark for watch mode recompiles
+ * Compiles generated programs of growing size by starting ./compfs on them,
+ * as a shell loop does on every save, and by forking an already loaded
+ * process the way --watch does, reporting the latency of each and checking
+ * both write the same target
+*/
+
+#include <iostream>
+#include <algorithm>
+#include <cstdio>
+#include <cstdlib>
+#include <chrono>
+#include <fstream>
+#include <sstream>
+#include <string>
+#include <vector>
+
+#include "optimizer.h"
+#include "parser.h"
+#include "runtime_semantics.h"
+#include "watch.h"
+
+const unsigned int GROUP_COUNTS[] = { 1, 100, 1000 };
+const unsigned int RUNS = 21;
+const std::string SOURCE_BASE = "watch_bench";
+
+std::string generate_program(unsigned int groups) {
+  std::string source = "declare total = 0 ;\ndeclare step = 3 ;\nprogram\nstart\n";
+
+  for (unsigned int g = 0; g < groups; g++) {
+    source += "  start\n    declare c = " + std::to_string(g % 7) + " ;\n";
+    source += "    assign total = total + c * ( step - 1 ) / 2 ;\n";
+    source += "    if [ total > 1000 ] then assign total = total - 1000 ; else talk total ; ;\n";
+    source += "    while [ c > 0 ] start assign c = c - 1 ; talk c * step + total ; stop ;\n";
+    source += "  stop\n";
+  }
+
+  return source + "stop\n";
+}
+
+// What compfs does for a file argument, without the messages
+void compile_source(const std::string &path) {
+  std::ifstream source_fp(path);
+
+  Node *root = parser(source_fp);
+  optimize_tree(root);
+
+  initialize_semantics(root, SOURCE_BASE + ".asm");
+}
+
+std::string read_file(const std::string &filename) {
+  std::ifstream in_fp(filename);
+  std::stringstream contents;
+  contents << in_fp.rdbuf();
+
+  return contents.str();
+}
+
+double median(std::vector<double> &times) {
+  std::sort(times.begin(), times.end());
+  return times[times.size() / 2];
+}
+
+int main() {
+  const std::string SOURCE_FILE = SOURCE_BASE + ".fl2021";
+  const std::string COMMAND = "./compfs " + SOURCE_FILE + " > /dev/null";
+
+  for (unsigned int groups: GROUP_COUNTS) {
+    std::ofstream out_fp(SOURCE_FILE);
+    out_fp << generate_program(groups);
+    out_fp.close();
+
+    std::vector<double> process_times;
+    std::vector<double> fork_times;
+
+    for (unsigned int r = 0; r < RUNS; r++) {
+      auto start = std::chrono::steady_clock::now();
+
+      if (std::system(COMMAND.c_str()) != 0) {
+        std::cout << "./compfs failed, build it first with make" << std::endl;
+        return EXIT_FAILURE;
+      }
+
+      process_times.push_back(std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count());
+    }
+
+    std::string process_output = read_file(SOURCE_BASE + ".asm");
+
+    for (unsigned int r = 0; r < RUNS; r++) {
+      bool succeeded;
+      fork_times.push_back(compile_in_child(SOURCE_FILE, compile_source, succeeded));
+
+      if (!succeeded) {
+        std::cout << "Forked compile failed" << std::endl;
+        return EXIT_FAILURE;
+      }
+    }
+
+    if (read_file(SOURCE_BASE + ".asm") != process_output) {
+      std::cout << "Forked compile wrote a different target" << std::endl;
+      return EXIT_FAILURE;
+    }
+
+    std::cout << "Groups: " << groups
+      << ", new process: " << median(process_times) << " ms"
+      << ", forked from warm process: " << median(fork_times) << " ms" << std::endl;
+  }
+
+  std::remove(SOURCE_FILE.c_str());
+  std::remove((SOURCE_BASE + ".asm").c_str());
+
+  return 0;
+}
@@ -0,0 +1,135 @@
+#include <sstream>
+#include <streambuf>
+
+#include "compfs.h"
+#include "ir.h"
+#include "optimizer.h"
+#include "parallel_codegen.h"
+#include "parser.h"
+#include "runtime_semantics.h"
+#include "scan_pipeline.h"
+#include "tree_traversal.h"
+
+// Reads the caller's buffer in place instead of copying it
+struct Buffer_Source : public std::streambuf {
+  Buffer_Source(const char *src, size_t len) {
+    char *start = const_cast<char *>(src);
+    setg(start, start, start + len);
+  }
+};
+
+// Parse, optimize and generate, errors throw Compile_Abort out of here
+void compile_tree(std::istream &source_fp, std::ostream &listing, Compile_Result &result) {
+  Node *root = parser(source_fp);
+
+  if (root == nullptr) {
+    report_diagnostic(PARSER_ERROR, 0, "Parser failed to load data.\n");
+    abort_compile();
+  }
+
+  // Print the tree as parsed, before any pass changes it
+  if (compile_options.dump_ast != AST_NONE) {
+    dump_tree(root, compile_options.dump_ast, listing);
+  }
+
+  if (compile_options.tree_passes) {
+    optimize_tree(root);
+  }
+
+  // Three address IR, only built when asked for
+  if (compile_options.dump_ir || compile_options.via_ir) {
+    IR_Function function;
+    build_ir(root, function);
+    remove_unreachable(function);
+    remove_dead_assignments(function);
+
+    if (compile_options.dump_ir) {
+      print_ir(function, listing);
+    }
+
+    if (compile_options.via_ir) {
+      lower_ir(function);
+    }
+  }
+
+  // Through the IR, lower_ir() already generated the code
+  if (!compile_options.via_ir) {
+    if (compile_options.codegen_threads > 1) {
+      parallel_semantics(root, compile_options.codegen_threads);
+    }
+    else {
+      initialize_semantics(root);
+    }
+  }
+
+  for (const std::string &line: get_asm_lines()) {
+    result.assembly += line;
+    result.assembly += "\n";
+  }
+
+  if (compile_options.source_map && !compile_options.via_ir) {
+    std::ostringstream map_fp;
+    print_source_map(map_fp);
+
+    result.source_map = map_fp.str();
+  }
+}
+
+// Points the per thread state at one compile and puts it back however the compile ends,
+// Compile_Abort or any other exception
+struct Compile_Scope {
+  Compile_Options outer_options;
+
+  // Every node is freed at the end, whether or not it made it into the tree
+  std::vector<Node *> nodes;
+
+  Compile_Scope(const Compile_Options &options, Compile_Result &result) {
+    outer_options = compile_options;
+    compile_options = options;
+    compile_options.stream = false;
+
+    own_nodes(&nodes);
+    collect_diagnostics(&result.diagnostics);
+    set_output_filename("");
+  }
+
+  ~Compile_Scope() {
+    // An error can leave the scanner thread running and the statement hook set
+    stop_scan_thread();
+    set_stat_hook(nullptr);
+
+    collect_diagnostics(nullptr);
+    own_nodes(nullptr);
+
+    // Annotations and code point into the tree
+    clear_tree_annotations();
+    reset_semantics();
+
+    for (Node *node: nodes) {
+      delete node;
+    }
+
+    compile_options = outer_options;
+  }
+};
+
+Compile_Result compile(const char *src, size_t len, const Compile_Options &options) {
+  Compile_Result result;
+  Compile_Scope scope(options, result);
+
+  Buffer_Source buffer(src, len);
+  std::istream source_fp(&buffer);
+  std::ostringstream listing;
+
+  try {
+    compile_tree(source_fp, listing, result);
+    result.succeeded = true;
+  }
+  catch (const Compile_Abort &) {
+    result.assembly.clear();
+  }
+
+  result.listing = listing.str();
+
+  return result;
+}
@@ -0,0 +1,37 @@
+#ifndef COMPFS_H
+#define COMPFS_H
+
+#include <cstddef>
+#include <string>
+#include <vector>
+
+#include "diagnostics.h"
+#include "options.h"
+
+// Outcome of compiling one source
+struct Compile_Result {
+  bool succeeded;
+
+  // Target as a .asm file holds it, program then storage
+  std::string assembly;
+
+  // Lines of the .map file, when the options ask for a source map
+  std::string source_map;
+
+  // Tree and IR printed when the options ask for them, in that order
+  std::string listing;
+
+  // Errors in the order found, the first one ends the compile
+  std::vector<Diagnostic> diagnostics;
+
+  Compile_Result() {
+    this->succeeded = false;
+  }
+};
+
+// Compile a source held in memory, nothing is printed, written or exited
+// Every stage keeps its state per thread, so compiles can run on separate threads at once
+// The whole tree is compiled, streaming is left to the command line
+Compile_Result compile(const char *, size_t, const Compile_Options & = Compile_Options());
+
+#endif
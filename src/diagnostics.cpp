@@ -0,0 +1,33 @@
+#include <cstdlib>
+#include <iostream>
+
+#include "diagnostics.h"
+
+// List the compile running on this thread keeps its diagnostics in, if any
+static thread_local std::vector<Diagnostic> *collected = nullptr;
+
+void report_diagnostic(Diagnostic_Kind kind, unsigned int line, const std::string &message) {
+  if (collected == nullptr) {
+    std::cout << message << std::flush;
+    return;
+  }
+
+  Diagnostic diagnostic;
+  diagnostic.kind = kind;
+  diagnostic.line = line;
+  diagnostic.message = message;
+
+  collected->push_back(diagnostic);
+}
+
+void collect_diagnostics(std::vector<Diagnostic> *diagnostics) {
+  collected = diagnostics;
+}
+
+void abort_compile() {
+  if (collected != nullptr) {
+    throw Compile_Abort();
+  }
+
+  exit(EXIT_FAILURE);
+}
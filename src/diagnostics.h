@@ -0,0 +1,32 @@
+#ifndef DIAGNOSTICS_H
+#define DIAGNOSTICS_H
+
+#include <string>
+#include <vector>
+
+enum Diagnostic_Kind {
+  SCANNER_ERROR,
+  PARSER_ERROR,
+  SEMANTIC_ERROR
+};
+
+// Error found while compiling, message is the text the command line prints for it
+struct Diagnostic {
+  Diagnostic_Kind kind;
+  unsigned int line;
+  std::string message;
+};
+
+// Unwinds a compile that collects its diagnostics once one ended it
+struct Compile_Abort {};
+
+// Print an error, or keep it when the compile on this thread collects them
+void report_diagnostic(Diagnostic_Kind, unsigned int, const std::string &);
+
+// Collect this thread's diagnostics into a list, nullptr prints them again
+void collect_diagnostics(std::vector<Diagnostic> *);
+
+// End the compile after its error, throws Compile_Abort while collecting and exits otherwise
+[[noreturn]] void abort_compile();
+
+#endif
@@ -0,0 +1,164 @@
+#include <cstdlib>
+#include <map>
+#include <sstream>
+#include <string>
+#include <vector>
+
+#include "executor.h"
+
+// Decoded instruction, argument may be a number, a name or a label
+struct Instruction {
+  std::string op;
+  std::string arg;
+};
+
+// Check if an argument is a literal number
+bool is_number(const std::string &arg) {
+  if (arg.empty()) { return false; }
+
+  unsigned int start = (arg[0] == '-') ? 1 : 0;
+  if (start == arg.size()) { return false; }
+
+  for (unsigned int i = start; i < arg.size(); i++) {
+    if (!isdigit(arg[i])) { return false; }
+  }
+
+  return true;
+}
+
+// Run assembly lines on a reference accumulator machine
+// Program lines come first, storage ("name value") follows the blank line
+// Stops at STOP, on an error, or once the step limit is hit
+Exec_Result execute_asm(const std::vector<std::string> &lines, const std::vector<long long> &input, unsigned long long step_limit) {
+  Exec_Result result;
+
+  std::vector<Instruction> program;
+  std::map<std::string, unsigned int> labels;
+  std::map<std::string, long long> memory;
+
+  bool in_storage = false;
+
+  for (const std::string &line: lines) {
+    if (line.empty()) {
+      in_storage = true;
+      continue;
+    }
+
+    std::istringstream words(line);
+    std::string first;
+    words >> first;
+
+    if (in_storage) {
+      long long value = 0;
+      words >> value;
+      memory[first] = value;
+      continue;
+    }
+
+    // Label declarations mark the instruction on the same line
+    if (first.back() == ':') {
+      labels[first.substr(0, first.size() - 1)] = program.size();
+      words >> first;
+    }
+
+    Instruction instruction;
+    instruction.op = first;
+    words >> instruction.arg;
+
+    program.push_back(instruction);
+  }
+
+  long long acc = 0;
+  std::vector<long long> stack;
+  unsigned int pc = 0;
+  unsigned int next_input = 0;
+
+  while (result.executed < step_limit) {
+    if (pc >= program.size()) {
+      result.error = "Ran past the end of the program";
+      return result;
+    }
+
+    const Instruction &in = program[pc];
+    pc++;
+    result.executed++;
+
+    // Resolve an argument as an immediate or a storage name
+    long long value = 0;
+    if (is_number(in.arg)) {
+      value = atoll(in.arg.c_str());
+    }
+    else if (!in.arg.empty() && memory.count(in.arg) != 0) {
+      value = memory[in.arg];
+    }
+
+    // Branch target when the instruction is a branch
+    bool branch = false;
+
+    if (in.op == "STOP") {
+      result.finished = true;
+      return result;
+    }
+    else if (in.op == "NOOP") {}
+    else if (in.op == "LOAD") { acc = value; }
+    else if (in.op == "STORE") { memory[in.arg] = acc; }
+    else if (in.op == "ADD") { acc += value; }
+    else if (in.op == "SUB") { acc -= value; }
+    else if (in.op == "MULT") { acc *= value; }
+    else if (in.op == "DIV") {
+      if (value == 0) {
+        result.error = "Division by zero";
+        return result;
+      }
+      acc /= value;
+    }
+    else if (in.op == "READ") {
+      if (next_input >= input.size()) {
+        result.error = "Input exhausted";
+        return result;
+      }
+      memory[in.arg] = input[next_input++];
+    }
+    else if (in.op == "WRITE") { result.output.push_back(value); }
+    else if (in.op == "PUSH") { stack.push_back(0); }
+    else if (in.op == "POP") {
+      if (stack.empty()) {
+        result.error = "Stack underflow";
+        return result;
+      }
+      stack.pop_back();
+    }
+    else if (in.op == "STACKW" || in.op == "STACKR") {
+      if ((unsigned long long) value >= stack.size()) {
+        result.error = "Stack access out of range";
+        return result;
+      }
+
+      long long &slot = stack[stack.size() - 1 - value];
+
+      if (in.op == "STACKW") { slot = acc; }
+      else { acc = slot; }
+    }
+    else if (in.op == "BR") { branch = true; }
+    else if (in.op == "BRNEG") { branch = acc < 0; }
+    else if (in.op == "BRZNEG") { branch = acc <= 0; }
+    else if (in.op == "BRPOS") { branch = acc > 0; }
+    else if (in.op == "BRZPOS") { branch = acc >= 0; }
+    else if (in.op == "BRZERO") { branch = acc == 0; }
+    else {
+      result.error = "Unknown instruction " + in.op;
+      return result;
+    }
+
+    if (branch) {
+      if (labels.count(in.arg) == 0) {
+        result.error = "Unknown label " + in.arg;
+        return result;
+      }
+      pc = labels[in.arg];
+    }
+  }
+
+  result.error = "Step limit reached";
+  return result;
+}
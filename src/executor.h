@@ -0,0 +1,23 @@
+#ifndef EXECUTOR_H
+#define EXECUTOR_H
+
+#include <string>
+#include <vector>
+
+// What a run of generated assembly did
+struct Exec_Result {
+  std::vector<long long> output;
+  unsigned long long executed;
+  bool finished;
+  std::string error;
+
+  Exec_Result() {
+    this->executed = 0;
+    this->finished = false;
+  }
+};
+
+// Run assembly lines on a reference accumulator machine
+Exec_Result execute_asm(const std::vector<std::string> &, const std::vector<long long> &, unsigned long long);
+
+#endif
@@ -0,0 +1,620 @@
+#include <iostream>
+#include <string>
+#include <vector>
+#include <unordered_map>
+
+#include "incremental.h"
+#include "optimizer.h"
+#include "parser.h"
+#include "scanner.h"
+#include "runtime_semantics.h"
+
+// Position of a token, line is 1 based like the scanner
+struct Token_Pos {
+  unsigned int line;
+  unsigned int index;
+
+  Token_Pos() {
+    this->line = 0;
+    this->index = 0;
+  }
+
+  Token_Pos(unsigned int line, unsigned int index) {
+    this->line = line;
+    this->index = index;
+  }
+};
+
+// First and last token covered by a node
+struct Span {
+  Token_Pos first;
+  Token_Pos last;
+  bool empty;
+
+  Span() {
+    this->empty = true;
+  }
+};
+
+// Code emitted for one top level statement
+// Temps and labels are numbered from the bases, shifted on reuse
+struct Chunk {
+  std::vector<std::string> lines;
+  unsigned int temp_base;
+  unsigned int temp_count;
+  unsigned int label_base;
+  unsigned int label_count;
+  unsigned int stack_size;
+
+  // Spill slots storage needs for the chunk, they are shared and never renumbered
+  unsigned int spill_count;
+};
+
+// A statement that may be reparsed in place of the edit
+struct Candidate {
+  Node *node;
+  Node *parent;
+  Token_Pos start;
+  Token_Pos end;
+};
+
+// Previous compile kept between edits, one per thread
+static thread_local std::vector<std::string> source_lines;
+static thread_local std::vector<std::vector<Token> > line_tokens;
+static thread_local Node *inc_root = nullptr;
+static thread_local std::string inc_filename;
+
+static thread_local std::unordered_map<Node *, Span> spans;
+
+// Tokens each node consumed itself, the tree only keeps their payload
+static thread_local std::unordered_map<Node *, Span> token_spans;
+static thread_local std::unordered_map<Node *, Chunk> chunks;
+
+// Code of the last compile, moved out of the code buffer compile() starts over
+static thread_local std::vector<std::string> inc_asm;
+
+// Stats of the compile in progress
+static thread_local Incremental_Stats *current_stats = nullptr;
+
+const std::string GENERATED_LABEL_PREFIX = "L_";
+
+bool pos_less(const Token_Pos &a, const Token_Pos &b) {
+  return a.line < b.line || (a.line == b.line && a.index < b.index);
+}
+
+bool pos_equal(const Token_Pos &a, const Token_Pos &b) {
+  return a.line == b.line && a.index == b.index;
+}
+
+Token_Pos token_pos(const Token &tk) {
+  return Token_Pos(tk.line_num, tk.line_index);
+}
+
+// Position of the EOF token, one line past the source
+Token_Pos eof_pos() {
+  return Token_Pos(line_tokens.size() + 1, 0);
+}
+
+// Position of the first token found at or after the given line
+Token_Pos first_pos_from(unsigned int line) {
+  for (unsigned int i = line; i <= line_tokens.size(); i++) {
+    if (!line_tokens[i - 1].empty()) {
+      return Token_Pos(i, 0);
+    }
+  }
+
+  return eof_pos();
+}
+
+// Position of the token right after the given one
+Token_Pos next_pos(const Token_Pos &pos) {
+  if (pos.index + 1 < line_tokens[pos.line - 1].size()) {
+    return Token_Pos(pos.line, pos.index + 1);
+  }
+
+  return first_pos_from(pos.line + 1);
+}
+
+// Split a source into lines, a final newline does not start a new line
+std::vector<std::string> split_lines(const std::string &source) {
+  std::vector<std::string> lines;
+  std::string line;
+
+  for (char c: source) {
+    if (c == '\n') {
+      lines.push_back(line);
+      line.clear();
+    }
+    else {
+      line.push_back(c);
+    }
+  }
+
+  if (!line.empty()) {
+    lines.push_back(line);
+  }
+
+  return lines;
+}
+
+// Parser hook, widens the span of the node consuming a token
+void record_token(Node *node, const Token &tk) {
+  Span &span = token_spans[node];
+  Token_Pos pos = token_pos(tk);
+
+  if (span.empty || pos_less(pos, span.first)) { span.first = pos; }
+  if (span.empty || pos_less(span.last, pos)) { span.last = pos; }
+  span.empty = false;
+}
+
+// Fill in spans of a node from its tokens and already computed children
+void update_span(Node *node) {
+  Span span;
+
+  auto own = token_spans.find(node);
+  if (own != token_spans.end()) {
+    span = own->second;
+  }
+
+  for (Node *child: node->children) {
+    if (child == nullptr) { continue; }
+
+    const Span &child_span = spans[child];
+    if (child_span.empty) { continue; }
+
+    if (span.empty || pos_less(child_span.first, span.first)) { span.first = child_span.first; }
+    if (span.empty || pos_less(span.last, child_span.last)) { span.last = child_span.last; }
+    span.empty = false;
+  }
+
+  spans[node] = span;
+}
+
+// Post-order span computation over a subtree
+void compute_spans(Node *node) {
+  if (node == nullptr) { return; }
+
+  for (Node *child: node->children) {
+    compute_spans(child);
+  }
+
+  update_span(node);
+}
+
+// Move nodes below an edit by the change in line count
+void shift_tree(Node *node, unsigned int after_line, int delta) {
+  if (node == nullptr) { return; }
+
+  if (node->line > after_line) {
+    node->line += delta;
+  }
+
+  for (Node *child: node->children) {
+    shift_tree(child, after_line, delta);
+  }
+}
+
+// Free a subtree along with anything cached for it
+void delete_tree(Node *node) {
+  if (node == nullptr) { return; }
+
+  for (Node *child: node->children) {
+    delete_tree(child);
+  }
+
+  spans.erase(node);
+  token_spans.erase(node);
+  chunks.erase(node);
+
+  delete node;
+}
+
+// Declarations in order, with block markers, used to spot scoping changes
+void scope_signature(Node *node, std::vector<std::string> &signature) {
+  if (node == nullptr) { return; }
+
+  if (node->func_label == "<vars>") {
+    signature.push_back(node->symbol);
+  }
+  else if (node->func_label == "<label>") {
+    signature.push_back(GENERATED_LABEL_PREFIX + node->symbol);
+  }
+  else if (node->func_label == "<block>") {
+    signature.push_back("start");
+  }
+
+  for (Node *child: node->children) {
+    scope_signature(child, signature);
+  }
+
+  if (node->func_label == "<block>") {
+    signature.push_back("stop");
+  }
+}
+
+// Emit a cached chunk at the current temp and label counters
+void replay_chunk(Chunk &chunk) {
+  std::vector<std::string> &lines = get_asm_lines();
+
+  int temp_shift = get_temp_count() - chunk.temp_base;
+  int label_shift = get_label_count() - chunk.label_base;
+
+  for (std::string &line: chunk.lines) {
+    if (temp_shift != 0 || label_shift != 0) {
+      line = rebase_line(line, temp_shift, label_shift);
+    }
+
+    lines.push_back(line);
+  }
+
+  // Claim the same amount of temps and labels the chunk was built with
+  for (unsigned int i = 0; i < chunk.temp_count; i++) {
+    generate_temp(VARIABLE);
+  }
+
+  for (unsigned int i = 0; i < chunk.label_count; i++) {
+    generate_temp(LABEL);
+  }
+
+  reserve_spills(chunk.spill_count);
+
+  chunk.temp_base += temp_shift;
+  chunk.label_base += label_shift;
+}
+
+// Hook for statements directly in the program <block>
+// Reuses the chunk of an untouched statement, otherwise generates and caches it
+void emit_top_stat(Node *stat, int var_count) {
+  auto cached = chunks.find(stat);
+
+  if (cached != chunks.end() && cached->second.stack_size == get_stack_size()) {
+    replay_chunk(cached->second);
+    current_stats->reused_chunks++;
+
+    return;
+  }
+
+  std::vector<std::string> &lines = get_asm_lines();
+  unsigned int start = lines.size();
+
+  Chunk chunk;
+  chunk.temp_base = get_temp_count();
+  chunk.label_base = get_label_count();
+  chunk.stack_size = get_stack_size();
+
+  iterate_children(stat, var_count);
+
+  current_stats->generated_chunks++;
+
+  // Labels and jumps are matched up on every compile, so they are always regenerated
+  if (contains_node(stat, "<label>") || contains_node(stat, "<goto>")) {
+    chunks.erase(stat);
+
+    return;
+  }
+
+  chunk.lines.assign(lines.begin() + start, lines.end());
+  chunk.temp_count = get_temp_count() - chunk.temp_base;
+  chunk.label_count = get_label_count() - chunk.label_base;
+  chunk.spill_count = get_spill_count();
+
+  chunks[stat] = chunk;
+}
+
+// Generate code for the current tree, reusing chunks where possible
+// Tree passes do not run here (see incremental.h), so drop what they found for another tree
+void generate() {
+  clear_tree_annotations();
+
+  set_stat_hook(emit_top_stat);
+  initialize_semantics(inc_root, inc_filename);
+  set_stat_hook(nullptr);
+
+  inc_asm.swap(get_asm_lines());
+  get_asm_lines().clear();
+}
+
+// Parse the whole token stream again, nothing cached survives
+void full_reparse() {
+  delete_tree(inc_root);
+
+  spans.clear();
+  token_spans.clear();
+  chunks.clear();
+
+  set_token_hook(record_token);
+  inc_root = parse_tokens(line_tokens);
+  set_token_hook(nullptr);
+
+  compute_spans(inc_root);
+
+  current_stats->full_reparse = true;
+  current_stats->full_codegen = true;
+}
+
+void incremental_clear() {
+  delete_tree(inc_root);
+  inc_root = nullptr;
+
+  spans.clear();
+  token_spans.clear();
+  chunks.clear();
+  inc_asm.clear();
+
+  source_lines.clear();
+  line_tokens.clear();
+}
+
+Incremental_Stats incremental_load(const std::string &source, const std::string &filename) {
+  Incremental_Stats stats;
+  current_stats = &stats;
+
+  incremental_clear();
+
+  inc_filename = filename;
+  source_lines = split_lines(source);
+
+  for (unsigned int i = 0; i < source_lines.size(); i++) {
+    line_tokens.push_back(scan_line(source_lines[i], i + 1));
+  }
+
+  stats.relexed_lines = source_lines.size();
+
+  full_reparse();
+  generate();
+
+  current_stats = nullptr;
+
+  return stats;
+}
+
+Incremental_Stats incremental_edit(unsigned int first, unsigned int last, const std::vector<std::string> &new_lines) {
+  Incremental_Stats stats;
+
+  // Nothing to edit yet or an invalid range, compile what is given
+  if (inc_root == nullptr || first < 1 || last + 1 < first || last > source_lines.size()) {
+    std::string source;
+
+    for (const std::string &line: new_lines) {
+      source += line + "\n";
+    }
+
+    return incremental_load(source, inc_filename);
+  }
+
+  current_stats = &stats;
+
+  int delta = (int) new_lines.size() - (int) (last + 1 - first);
+
+  // Re-lex only the replacement lines
+  std::vector<std::vector<Token> > new_tokens;
+
+  for (unsigned int i = 0; i < new_lines.size(); i++) {
+    new_tokens.push_back(scan_line(new_lines[i], first + i));
+  }
+
+  stats.relexed_lines = new_lines.size();
+
+  // Find the old tokens on the edited lines
+  // A token edit that only touched comments or spacing needs no reparse
+  bool region_empty = true;
+  bool same_tokens = true;
+  Token_Pos region_first;
+  Token_Pos region_last;
+
+  std::vector<Token> old_flat;
+  std::vector<Token> new_flat;
+
+  for (unsigned int line = first; line <= last; line++) {
+    for (const Token &tk: line_tokens[line - 1]) {
+      if (region_empty) { region_first = token_pos(tk); }
+      region_last = token_pos(tk);
+      region_empty = false;
+
+      old_flat.push_back(tk);
+    }
+  }
+
+  for (const std::vector<Token> &tokens: new_tokens) {
+    new_flat.insert(new_flat.end(), tokens.begin(), tokens.end());
+  }
+
+  if (old_flat.size() != new_flat.size()) {
+    same_tokens = false;
+  }
+  else {
+    for (unsigned int i = 0; i < old_flat.size(); i++) {
+      if (old_flat[i].token_ID != new_flat[i].token_ID
+          || old_flat[i].token_instance != new_flat[i].token_instance) {
+        same_tokens = false;
+        break;
+      }
+    }
+  }
+
+  // The range a reparsed statement must cover
+  // An insertion needs the tokens on both sides of it
+  Token_Pos need_first = region_first;
+  Token_Pos need_last = region_last;
+  bool has_range = true;
+
+  if (region_empty) {
+    need_last = first_pos_from(last + 1);
+    has_range = false;
+
+    for (unsigned int line = first - 1; line >= 1; line--) {
+      if (!line_tokens[line - 1].empty()) {
+        need_first = Token_Pos(line, line_tokens[line - 1].size() - 1);
+        has_range = true;
+        break;
+      }
+    }
+  }
+
+  // Walk down to the innermost node covering the edit
+  std::vector<Node *> path;
+  std::vector<Candidate> candidates;
+
+  if (has_range && !same_tokens) {
+    Node *current = inc_root;
+    path.push_back(current);
+
+    while (current != nullptr) {
+      Node *next = nullptr;
+
+      for (Node *child: current->children) {
+        if (child == nullptr) { continue; }
+
+        const Span &span = spans[child];
+        if (!span.empty && !pos_less(need_first, span.first) && !pos_less(span.last, need_last)) {
+          next = child;
+          break;
+        }
+      }
+
+      if (next != nullptr) { path.push_back(next); }
+      current = next;
+    }
+
+    // Every <stat> on the path can be reparsed, innermost first
+    for (int i = path.size() - 1; i > 0; i--) {
+      if (path[i]->func_label != "<stat>") { continue; }
+
+      const Span &span = spans[path[i]];
+
+      Candidate candidate;
+      candidate.node = path[i];
+      candidate.parent = path[i - 1];
+
+      // Statements starting inside the edit start at its first new token
+      if (!region_empty && pos_equal(span.first, region_first)) {
+        candidate.start = Token_Pos(first, 0);
+      }
+      else {
+        candidate.start = span.first;
+      }
+
+      // Token that followed the statement, moved by the line change
+      Token_Pos after = next_pos(span.last);
+
+      if (pos_equal(after, eof_pos())) {
+        candidate.end = Token_Pos(line_tokens.size() + 1 + delta, 0);
+      }
+      else {
+        candidate.end = Token_Pos(after.line + delta, after.index);
+      }
+
+      candidates.push_back(candidate);
+    }
+  }
+
+  // Apply the edit to the kept source and tokens
+  source_lines.erase(source_lines.begin() + (first - 1), source_lines.begin() + last);
+  source_lines.insert(source_lines.begin() + (first - 1), new_lines.begin(), new_lines.end());
+
+  line_tokens.erase(line_tokens.begin() + (first - 1), line_tokens.begin() + last);
+  line_tokens.insert(line_tokens.begin() + (first - 1), new_tokens.begin(), new_tokens.end());
+
+  if (delta != 0) {
+    for (unsigned int line = first + new_lines.size(); line <= line_tokens.size(); line++) {
+      for (Token &tk: line_tokens[line - 1]) {
+        tk.line_num = line;
+      }
+    }
+
+    shift_tree(inc_root, last, delta);
+
+    for (auto *span_map: { &spans, &token_spans }) {
+      for (auto &entry: *span_map) {
+        Span &span = entry.second;
+
+        if (span.first.line > last) { span.first.line += delta; }
+        if (span.last.line > last) { span.last.line += delta; }
+      }
+    }
+  }
+
+  // Only positions moved, the code is still the same
+  if (same_tokens) {
+    current_stats = nullptr;
+
+    return stats;
+  }
+
+  // Reparse the smallest statement that ends where it used to
+  bool reparsed = false;
+
+  for (const Candidate &candidate: candidates) {
+    set_token_hook(record_token);
+    Node *fresh = parse_statement(line_tokens, candidate.start.line - 1,
+      candidate.start.index, candidate.node->depth - 1);
+    set_token_hook(nullptr);
+
+    if (fresh == nullptr) { continue; }
+
+    Token next = lookahead_token();
+    Token_Pos next_at = next.token_ID == TK_EOF ? eof_pos() : token_pos(next);
+
+    if (!pos_equal(next_at, candidate.end)) {
+      delete_tree(fresh);
+      continue;
+    }
+
+    // Scoping changes fall back to a full rebuild of the code
+    std::vector<std::string> old_signature;
+    std::vector<std::string> new_signature;
+    scope_signature(candidate.node, old_signature);
+    scope_signature(fresh, new_signature);
+
+    if (old_signature != new_signature) {
+      chunks.clear();
+      stats.full_codegen = true;
+    }
+
+    for (Node *&child: candidate.parent->children) {
+      if (child == candidate.node) {
+        child = fresh;
+      }
+    }
+
+    delete_tree(candidate.node);
+    compute_spans(fresh);
+
+    // Enclosing nodes changed, drop their chunks and refresh their spans
+    unsigned int depth = 0;
+    while (path[depth] != candidate.node) { depth++; }
+
+    for (int i = depth - 1; i >= 0; i--) {
+      chunks.erase(path[i]);
+      update_span(path[i]);
+    }
+
+    stats.reparsed_statements++;
+    reparsed = true;
+    break;
+  }
+
+  if (!reparsed) {
+    full_reparse();
+  }
+
+  generate();
+
+  current_stats = nullptr;
+
+  return stats;
+}
+
+std::string incremental_output() {
+  std::string output;
+
+  for (const std::string &line: inc_asm) {
+    output += line + "\n";
+  }
+
+  return output;
+}
+
+Node *incremental_tree() {
+  return inc_root;
+}
@@ -0,0 +1,47 @@
+#ifndef INCREMENTAL_H
+#define INCREMENTAL_H
+
+#include <string>
+#include <vector>
+
+#include "node.h"
+
+// What the last compile had to redo
+struct Incremental_Stats {
+  unsigned int relexed_lines;
+  unsigned int reparsed_statements;
+  unsigned int reused_chunks;
+  unsigned int generated_chunks;
+  bool full_reparse;
+  bool full_codegen;
+
+  Incremental_Stats() {
+    this->relexed_lines = 0;
+    this->reparsed_statements = 0;
+    this->reused_chunks = 0;
+    this->generated_chunks = 0;
+    this->full_reparse = false;
+    this->full_codegen = false;
+  }
+};
+
+// Code is generated from the tree as parsed, the same as compile() with tree_passes off
+// (compfs --no-optimize). The tree passes look across the whole program, so a one line
+// edit could change the code of any statement and no chunk could be reused
+// Expect larger and slower code than a default compile of the same source
+// State is kept per thread, and compile() on the same thread leaves it alone
+
+// Full compile of an in memory source, keeps tokens, tree and code around
+Incremental_Stats incremental_load(const std::string &, const std::string & = "");
+
+// Replace source lines [first, last] (1 based, inclusive) with new lines
+// A last line of first - 1 inserts without removing anything
+Incremental_Stats incremental_edit(unsigned int, unsigned int, const std::vector<std::string> &);
+
+// Assembly and tree of the latest compile
+std::string incremental_output();
+Node *incremental_tree();
+
+void incremental_clear();
+
+#endif
@@ -0,0 +1,992 @@
+#include <algorithm>
+#include <cstdlib>
+#include <iostream>
+#include <iterator>
+#include <map>
+#include <string>
+#include <vector>
+
+#include "diagnostics.h"
+#include "ir.h"
+#include "labels.h"
+#include "optimizer.h"
+#include "runtime_semantics.h"
+
+// Function being built and the block instructions go to
+static thread_local IR_Function *ir = nullptr;
+static thread_local unsigned int current_block;
+
+// Innermost scope last, names map to variables
+static thread_local std::vector<std::map<std::string, unsigned int>> scopes;
+
+// User labels map to blocks, a jump ahead of its label is patched once it is seen
+static thread_local Label_Table ir_labels;
+
+// Block ending in each jump to a user label, and its token, by site
+static thread_local std::vector<std::pair<unsigned int, Token>> label_jumps;
+
+// How often each source name was declared, for unique IR names
+static thread_local std::map<std::string, unsigned int> name_uses;
+
+// Display a semantic error the way code generation does and end the compile
+void ir_error(const std::string &message, Token tk) {
+  report_diagnostic(SEMANTIC_ERROR, tk.line_num, "Semantic Error: " + message
+    + "\n\t Instance: " + tk.token_instance
+    + "\n\t Line: " + std::to_string(tk.line_num)
+    + "\n");
+
+  s_cleanup();
+
+  abort_compile();
+}
+
+unsigned int new_block() {
+  ir->blocks.push_back(IR_Block());
+
+  return ir->blocks.size() - 1;
+}
+
+void emit(const IR_Instr &instr) {
+  ir->blocks[current_block].instrs.push_back(instr);
+}
+
+IR_Operand new_temp() {
+  return IR_Operand(IR_TEMP, ir->temp_count++);
+}
+
+// End the current block with a jump
+void emit_jump(unsigned int target) {
+  IR_Instr jump(IR_JUMP);
+  jump.target = target;
+
+  emit(jump);
+}
+
+// Add a name to the innermost scope, false if it is already there
+bool declare_name(const std::string &name, unsigned int index) {
+  std::map<std::string, unsigned int> &scope = scopes.back();
+
+  if (scope.count(name) != 0) { return false; }
+
+  scope[name] = index;
+  return true;
+}
+
+// Find a name from the innermost scope out
+bool resolve_name(const std::string &name, unsigned int &index) {
+  for (unsigned int i = scopes.size(); i > 0; i--) {
+    auto found = scopes[i - 1].find(name);
+
+    if (found != scopes[i - 1].end()) {
+      index = found->second;
+      return true;
+    }
+  }
+
+  return false;
+}
+
+// New variable with a name unique in the whole program
+unsigned int new_var(Token tk, bool is_global) {
+  std::string name = tk.token_instance;
+  unsigned int uses = name_uses[name]++;
+
+  // Identifiers cannot hold _, so suffixed names never clash
+  IR_Var var;
+  var.name = (uses == 0) ? name : name + "_" + std::to_string(uses);
+  var.initial = 0;
+  var.is_global = is_global;
+
+  ir->vars.push_back(var);
+
+  unsigned int index = ir->vars.size() - 1;
+
+  if (!declare_name(name, index)) {
+    ir_error("Variable declared more than once.", tk);
+  }
+
+  return index;
+}
+
+IR_Operand variable_operand(Token tk) {
+  unsigned int index;
+
+  if (!resolve_name(tk.token_instance, index)) {
+    ir_error("Usage of undeclared variable.", tk);
+  }
+
+  return IR_Operand(IR_VAR, index);
+}
+
+// Lower an expression, the result is a constant, a variable or a temp
+// Second operands are evaluated first, as code generation does
+IR_Operand lower_expression(Node *node) {
+  std::string label = node->func_label;
+
+  // Identifier | Integer
+  if (label == "<R>") {
+    if (node->op == TK_INT) {
+      return IR_Operand(IR_CONST, node->value);
+    }
+
+    return variable_operand(symbol_token(node));
+  }
+
+  // <M> -> . <M>
+  if (label == "<M>") {
+    IR_Instr neg(IR_NEG);
+    neg.left = lower_expression(node->children[0]);
+    neg.dest = new_temp();
+
+    emit(neg);
+    return neg.dest;
+  }
+
+  IR_Operand right = lower_expression(node->children[1]);
+  IR_Operand left = lower_expression(node->children[0]);
+
+  Token_Type tk = node->op;
+
+  IR_Op op = IR_ADD;
+  if (tk == TK_MINUS) { op = IR_SUB; }
+  else if (tk == TK_STAR) { op = IR_MULT; }
+  else if (tk == TK_SLASH) { op = IR_DIV; }
+
+  IR_Instr instr(op);
+  instr.left = left;
+  instr.right = right;
+  instr.dest = new_temp();
+
+  emit(instr);
+  return instr.dest;
+}
+
+// Lower [ <expr> <RO> <expr> ], returns the branch to patch the false target of
+unsigned int lower_condition(Node *node, unsigned int true_block) {
+  IR_Instr branch(IR_BRANCH);
+
+  branch.right = lower_expression(node->children[2]);
+  branch.left = lower_expression(node->children[0]);
+  branch.relation = node->children[1]->op;
+  branch.target = true_block;
+
+  emit(branch);
+  return current_block;
+}
+
+void lower_statement(Node *);
+
+// <block> -> start <vars> <stats> stop
+void lower_block(Node *node) {
+  scopes.push_back(std::map<std::string, unsigned int>());
+  ir_labels.open_scope();
+
+  // Locals are set again every time the block is entered
+  for (Node *vars = node->children[0]; vars != nullptr; vars = vars->children[0]) {
+    IR_Instr init(IR_COPY);
+    init.dest = IR_Operand(IR_VAR, new_var(symbol_token(vars), false));
+    init.left = IR_Operand(IR_CONST, vars->value);
+
+    emit(init);
+  }
+
+  std::vector<Node **> slots;
+  collect_stats(node->children[1], slots);
+
+  for (Node **slot: slots) {
+    lower_statement(*slot);
+  }
+
+  ir_labels.close_scope();
+  scopes.pop_back();
+}
+
+// Lower one <stat>, control flow starts new blocks
+void lower_statement(Node *stat) {
+  Node *kind = statement_kind(stat);
+  if (kind == nullptr) { return; }
+
+  std::string label = kind->func_label;
+
+  // <in> -> listen Identifier
+  if (label == "<in>") {
+    IR_Instr read(IR_READ);
+    read.dest = variable_operand(symbol_token(kind));
+
+    emit(read);
+  }
+  // <out> -> talk <expr>
+  else if (label == "<out>") {
+    IR_Instr write(IR_WRITE);
+    write.left = lower_expression(kind->children[0]);
+
+    emit(write);
+  }
+  // <assign> -> assign Identifier = <expr>
+  else if (label == "<assign>") {
+    IR_Operand value = lower_expression(kind->children[0]);
+    IR_Operand var = variable_operand(symbol_token(kind));
+
+    std::vector<IR_Instr> &instrs = ir->blocks[current_block].instrs;
+
+    // Write straight into the variable instead of through the temp
+    if (value.type == IR_TEMP && !instrs.empty()
+        && instrs.back().dest.type == IR_TEMP && instrs.back().dest.value == value.value) {
+      instrs.back().dest = var;
+    }
+    else {
+      IR_Instr copy(IR_COPY);
+      copy.dest = var;
+      copy.left = value;
+
+      emit(copy);
+    }
+  }
+  // <block> -> start <vars> <stats> stop
+  else if (label == "<block>") {
+    lower_block(kind);
+  }
+  // <if> -> if [ <expr> <RO> <expr> ] then <stat> [else <stat>]
+  else if (label == "<if>") {
+    unsigned int then_block = new_block();
+    unsigned int branch_block = lower_condition(kind, then_block);
+
+    current_block = then_block;
+    lower_statement(kind->children[3]);
+    unsigned int then_end = current_block;
+
+    unsigned int else_end = 0;
+    unsigned int else_block = 0;
+    bool has_else = kind->children.size() == 5;
+
+    if (has_else) {
+      else_block = new_block();
+
+      current_block = else_block;
+      lower_statement(kind->children[4]);
+      else_end = current_block;
+    }
+
+    unsigned int join = new_block();
+
+    ir->blocks[branch_block].instrs.back().other = has_else ? else_block : join;
+
+    current_block = then_end;
+    emit_jump(join);
+
+    if (has_else) {
+      current_block = else_end;
+      emit_jump(join);
+    }
+
+    current_block = join;
+  }
+  // <loop> -> while [ <expr> <RO> <expr> ] <stat>
+  else if (label == "<loop>") {
+    unsigned int check = new_block();
+    emit_jump(check);
+
+    current_block = check;
+    unsigned int body = new_block();
+    unsigned int branch_block = lower_condition(kind, body);
+
+    current_block = body;
+    lower_statement(kind->children[3]);
+    emit_jump(check);
+
+    unsigned int exit_block = new_block();
+    ir->blocks[branch_block].instrs.back().other = exit_block;
+
+    current_block = exit_block;
+  }
+  // <label> -> label Identifier
+  else if (label == "<label>") {
+    Token tk = symbol_token(kind);
+
+    unsigned int target = new_block();
+    emit_jump(target);
+
+    std::vector<unsigned int> resolved;
+
+    if (!ir_labels.define(tk.token_instance, target, resolved)) {
+      ir_error("Identifier declared more than once.", tk);
+    }
+
+    for (unsigned int site: resolved) {
+      ir->blocks[label_jumps[site].first].instrs.back().target = target;
+    }
+
+    current_block = target;
+  }
+  // <goto> -> jump Identifier
+  else if (label == "<goto>") {
+    Token tk = symbol_token(kind);
+    unsigned int target = 0;
+
+    // Without a label yet the target is filled in when one is declared
+    ir_labels.jump(tk.token_instance, label_jumps.size(), target);
+    label_jumps.push_back(std::make_pair(current_block, tk));
+
+    emit_jump(target);
+
+    // Anything after the jump is only reachable through a label
+    current_block = new_block();
+  }
+}
+
+// Lower a checked tree into basic blocks
+// <program> -> <vars> program <block>
+void build_ir(Node *root, IR_Function &function) {
+  function = IR_Function();
+
+  ir = &function;
+  scopes.clear();
+  name_uses.clear();
+  ir_labels.clear();
+  label_jumps.clear();
+
+  scopes.push_back(std::map<std::string, unsigned int>());
+  current_block = new_block();
+
+  // Globals keep their name and start out with their declared value
+  for (Node *vars = root->children[0]; vars != nullptr; vars = vars->children[0]) {
+    unsigned int index = new_var(symbol_token(vars), true);
+    ir->vars[index].initial = vars->value;
+  }
+
+  lower_block(root->children[1]);
+
+  std::string name;
+  unsigned int site;
+
+  if (ir_labels.first_waiting(name, site)) {
+    ir_error("Usage of undeclared label identifier.", label_jumps[site].second);
+  }
+
+  emit(IR_Instr(IR_STOP));
+
+  ir = nullptr;
+  build_cfg(function);
+}
+
+// Fill successors and predecessors from the terminators
+void build_cfg(IR_Function &function) {
+  for (IR_Block &block: function.blocks) {
+    block.succs.clear();
+    block.preds.clear();
+  }
+
+  for (unsigned int b = 0; b < function.blocks.size(); b++) {
+    IR_Block &block = function.blocks[b];
+
+    // Code after a terminator can never run
+    for (unsigned int i = 0; i < block.instrs.size(); i++) {
+      IR_Op op = block.instrs[i].op;
+
+      if (op == IR_JUMP || op == IR_BRANCH || op == IR_STOP) {
+        block.instrs.resize(i + 1);
+        break;
+      }
+    }
+
+    const IR_Instr &last = block.instrs.back();
+
+    if (last.op == IR_JUMP || last.op == IR_BRANCH) {
+      block.succs.push_back(last.target);
+    }
+
+    if (last.op == IR_BRANCH && last.other != last.target) {
+      block.succs.push_back(last.other);
+    }
+
+    for (unsigned int succ: block.succs) {
+      function.blocks[succ].preds.push_back(b);
+    }
+  }
+}
+
+// Drop blocks the entry cannot reach and renumber the rest
+void remove_unreachable(IR_Function &function) {
+  std::vector<bool> reached(function.blocks.size(), false);
+  std::vector<unsigned int> work(1, 0);
+
+  reached[0] = true;
+
+  while (!work.empty()) {
+    unsigned int b = work.back();
+    work.pop_back();
+
+    for (unsigned int succ: function.blocks[b].succs) {
+      if (!reached[succ]) {
+        reached[succ] = true;
+        work.push_back(succ);
+      }
+    }
+  }
+
+  std::vector<unsigned int> renumber(function.blocks.size(), 0);
+  std::vector<IR_Block> kept;
+
+  for (unsigned int b = 0; b < function.blocks.size(); b++) {
+    if (reached[b]) {
+      renumber[b] = kept.size();
+      kept.push_back(function.blocks[b]);
+    }
+  }
+
+  for (IR_Block &block: kept) {
+    IR_Instr &last = block.instrs.back();
+
+    last.target = renumber[last.target];
+    last.other = renumber[last.other];
+  }
+
+  function.blocks.swap(kept);
+  build_cfg(function);
+}
+
+unsigned int Bit_Set::count() const {
+  unsigned int total = 0;
+
+  for (unsigned long long word: words) {
+    total += __builtin_popcountll(word);
+  }
+
+  return total;
+}
+
+bool Bit_Set::merge(const Bit_Set &other) {
+  bool changed = false;
+
+  for (unsigned int i = 0; i < words.size(); i++) {
+    unsigned long long merged = words[i] | other.words[i];
+
+    if (merged != words[i]) {
+      words[i] = merged;
+      changed = true;
+    }
+  }
+
+  return changed;
+}
+
+// Worklist solver for gen/kill problems joined by union
+// Forward problems flow from predecessors, backward ones from successors
+Dataflow_Result solve_dataflow(const IR_Function &function, bool forward, unsigned int size,
+    const std::vector<Bit_Set> &gen, const std::vector<Bit_Set> &kill) {
+  unsigned int count = function.blocks.size();
+
+  Dataflow_Result result;
+  result.in.assign(count, Bit_Set(size));
+  result.out.assign(count, Bit_Set(size));
+
+  // Facts flow into "before" and out of "after" in the direction of the problem
+  std::vector<Bit_Set> &before = forward ? result.in : result.out;
+  std::vector<Bit_Set> &after = forward ? result.out : result.in;
+
+  // Start in flow order so most facts settle on the first visit
+  std::vector<unsigned int> work;
+  std::vector<bool> queued(count, true);
+
+  for (unsigned int n = 0; n < count; n++) {
+    work.push_back(forward ? count - 1 - n : n);
+  }
+
+  Bit_Set updated(size);
+
+  while (!work.empty()) {
+    unsigned int b = work.back();
+    work.pop_back();
+    queued[b] = false;
+
+    const IR_Block &block = function.blocks[b];
+
+    for (unsigned int other: forward ? block.preds : block.succs) {
+      before[b].merge(after[other]);
+    }
+
+    for (unsigned int i = 0; i < updated.words.size(); i++) {
+      updated.words[i] = gen[b].words[i] | (before[b].words[i] & ~kill[b].words[i]);
+    }
+
+    if (!after[b].merge(updated)) { continue; }
+
+    // Only blocks reading this one can change
+    for (unsigned int other: forward ? block.succs : block.preds) {
+      if (!queued[other]) {
+        queued[other] = true;
+        work.push_back(other);
+      }
+    }
+  }
+
+  return result;
+}
+
+// Operands an instruction reads
+std::vector<IR_Operand> instr_uses(const IR_Instr &instr) {
+  std::vector<IR_Operand> uses;
+
+  if (instr.left.type != IR_NONE) { uses.push_back(instr.left); }
+  if (instr.right.type != IR_NONE) { uses.push_back(instr.right); }
+
+  return uses;
+}
+
+// Check if an instruction writes its dest operand
+bool has_dest(const IR_Instr &instr) {
+  return instr.dest.type == IR_VAR || instr.dest.type == IR_TEMP;
+}
+
+// Variables live on entry and exit of each block
+// Temps are made and used in one block, so they never cross an edge
+Dataflow_Result compute_liveness(const IR_Function &function) {
+  unsigned int size = function.vars.size();
+
+  std::vector<Bit_Set> gen(function.blocks.size(), Bit_Set(size));
+  std::vector<Bit_Set> kill(function.blocks.size(), Bit_Set(size));
+
+  for (unsigned int b = 0; b < function.blocks.size(); b++) {
+    for (const IR_Instr &instr: function.blocks[b].instrs) {
+      // Reads before any write in the block
+      for (const IR_Operand &use: instr_uses(instr)) {
+        if (use.type == IR_VAR && !kill[b].test(use.value)) {
+          gen[b].set(use.value);
+        }
+      }
+
+      if (instr.dest.type == IR_VAR) {
+        kill[b].set(instr.dest.value);
+      }
+    }
+  }
+
+  return solve_dataflow(function, false, size, gen, kill);
+}
+
+// Variable definitions reaching each block
+// A block kills every other definition of the variables it writes, so kill is
+// found from those variables as the block is visited instead of kept per definition
+Reaching_Defs compute_reaching_defs(const IR_Function &function) {
+  unsigned int count = function.blocks.size();
+
+  Reaching_Defs result;
+  result.in.assign(count, Def_Set());
+  result.out.assign(count, Def_Set());
+
+  // Variable of each definition, and the last definition of each variable in every block
+  std::vector<unsigned int> def_var;
+  std::vector<Def_Set> gen(count);
+
+  const unsigned int NO_DEF = -1;
+  std::vector<unsigned int> last_def(function.vars.size(), NO_DEF);
+  std::vector<unsigned int> written;
+
+  for (unsigned int b = 0; b < count; b++) {
+    const std::vector<IR_Instr> &instrs = function.blocks[b].instrs;
+
+    for (unsigned int i = 0; i < instrs.size(); i++) {
+      if (instrs[i].dest.type != IR_VAR) { continue; }
+
+      unsigned int var = instrs[i].dest.value;
+
+      if (last_def[var] == NO_DEF) {
+        written.push_back(var);
+      }
+
+      last_def[var] = result.defs.size();
+      def_var.push_back(var);
+      result.defs.push_back(std::make_pair(b, i));
+    }
+
+    for (unsigned int var: written) {
+      gen[b].push_back(last_def[var]);
+      last_def[var] = NO_DEF;
+    }
+
+    std::sort(gen[b].begin(), gen[b].end());
+    written.clear();
+  }
+
+  // Start in flow order so most facts settle on the first visit
+  std::vector<unsigned int> work;
+  std::vector<bool> queued(count, true);
+
+  for (unsigned int n = 0; n < count; n++) {
+    work.push_back(count - 1 - n);
+  }
+
+  std::vector<bool> killed(function.vars.size(), false);
+  Def_Set merged;
+  Def_Set kept;
+
+  while (!work.empty()) {
+    unsigned int b = work.back();
+    work.pop_back();
+    queued[b] = false;
+
+    const IR_Block &block = function.blocks[b];
+    Def_Set &in = result.in[b];
+
+    for (unsigned int pred: block.preds) {
+      const Def_Set &from = result.out[pred];
+
+      if (in.empty()) {
+        in = from;
+        continue;
+      }
+
+      merged.clear();
+      std::set_union(in.begin(), in.end(), from.begin(), from.end(), std::back_inserter(merged));
+      in.swap(merged);
+    }
+
+    // Sets only grow, so the same size means nothing changed
+    // Most blocks write no variable and pass on what reaches them
+    if (gen[b].empty()) {
+      if (in.size() == result.out[b].size()) { continue; }
+
+      result.out[b] = in;
+    }
+    else {
+      // gen, plus what reaches the block for variables it does not write
+      for (unsigned int def: gen[b]) { killed[def_var[def]] = true; }
+
+      kept.clear();
+
+      for (unsigned int def: in) {
+        if (!killed[def_var[def]]) { kept.push_back(def); }
+      }
+
+      for (unsigned int def: gen[b]) { killed[def_var[def]] = false; }
+
+      merged.clear();
+      std::set_union(kept.begin(), kept.end(), gen[b].begin(), gen[b].end(), std::back_inserter(merged));
+
+      if (merged.size() == result.out[b].size()) { continue; }
+
+      result.out[b].swap(merged);
+    }
+
+    for (unsigned int succ: block.succs) {
+      if (!queued[succ]) {
+        queued[succ] = true;
+        work.push_back(succ);
+      }
+    }
+  }
+
+  return result;
+}
+
+// Check if removing an instruction could hide a run time error
+bool may_trap(const IR_Instr &instr) {
+  return instr.op == IR_DIV && (instr.right.type != IR_CONST || instr.right.value == 0);
+}
+
+// Remove writes nothing reads afterwards, repeated until none are left
+// Returns how many instructions were removed
+unsigned int remove_dead_assignments(IR_Function &function) {
+  unsigned int removed = 0;
+  bool changed = true;
+
+  // Temps read later in the current block, each is written once before its reads
+  std::vector<bool> temp_live(function.temp_count, false);
+
+  while (changed) {
+    changed = false;
+
+    Dataflow_Result live = compute_liveness(function);
+
+    for (unsigned int b = 0; b < function.blocks.size(); b++) {
+      std::vector<IR_Instr> &instrs = function.blocks[b].instrs;
+      Bit_Set &live_now = live.out[b];
+
+      std::vector<IR_Instr> kept;
+
+      for (unsigned int i = instrs.size(); i > 0; i--) {
+        const IR_Instr &instr = instrs[i - 1];
+
+        if (has_dest(instr)) {
+          bool is_var = instr.dest.type == IR_VAR;
+          bool needed = is_var ? live_now.test(instr.dest.value) : temp_live[instr.dest.value];
+
+          // READ consumes input, so it stays
+          if (!needed && instr.op != IR_READ && !may_trap(instr)) {
+            removed++;
+
+            // Dropping a variable write can make writes in other blocks dead
+            if (is_var) { changed = true; }
+            continue;
+          }
+
+          if (is_var) { live_now.reset(instr.dest.value); }
+          else { temp_live[instr.dest.value] = false; }
+        }
+
+        for (const IR_Operand &use: instr_uses(instr)) {
+          if (use.type == IR_VAR) { live_now.set(use.value); }
+          else if (use.type == IR_TEMP) { temp_live[use.value] = true; }
+        }
+
+        kept.push_back(instr);
+      }
+
+      instrs.assign(kept.rbegin(), kept.rend());
+    }
+  }
+
+  return removed;
+}
+
+// Assembly name of an operand
+std::string operand_text(const IR_Function &function, const IR_Operand &operand) {
+  if (operand.type == IR_CONST) { return std::to_string(operand.value); }
+  if (operand.type == IR_VAR) { return function.vars[operand.value].name; }
+
+  return "T" + std::to_string(operand.value);
+}
+
+std::string block_name(unsigned int block) {
+  return "B" + std::to_string(block);
+}
+
+const char *relation_text(Token_Type relation) {
+  if (relation == TK_GREATER_THAN) { return ">"; }
+  if (relation == TK_LESS_THAN) { return "<"; }
+  if (relation == TK_EQUALS_EQUALS) { return "=="; }
+  if (relation == TK_L_BRACE) { return "{==}"; }
+
+  return "%";
+}
+
+// Print names of the variables in a liveness set
+void print_set(const IR_Function &function, const Bit_Set &set, std::ostream &out) {
+  out << "{";
+
+  bool first = true;
+
+  for (unsigned int bit = 0; bit < function.vars.size(); bit++) {
+    if (!set.test(bit)) { continue; }
+
+    out << (first ? "" : " ") << operand_text(function, IR_Operand(IR_VAR, bit));
+    first = false;
+  }
+
+  out << "}";
+}
+
+// Readable listing of the blocks, their edges and dataflow facts
+void print_ir(const IR_Function &function, std::ostream &out) {
+  Dataflow_Result live = compute_liveness(function);
+
+  Reaching_Defs reaching = compute_reaching_defs(function);
+
+  out << "vars:";
+  for (const IR_Var &var: function.vars) {
+    out << " " << var.name << (var.is_global ? "=" + std::to_string(var.initial) : "");
+  }
+  out << "\ntemps: " << function.temp_count << "\n";
+
+  for (unsigned int b = 0; b < function.blocks.size(); b++) {
+    const IR_Block &block = function.blocks[b];
+
+    out << "\n" << block_name(b) << ":  preds:";
+    for (unsigned int pred: block.preds) { out << " " << block_name(pred); }
+    out << "  succs:";
+    for (unsigned int succ: block.succs) { out << " " << block_name(succ); }
+
+    out << "\n  ; live in ";
+    print_set(function, live.in[b], out);
+    out << ", " << reaching.in[b].size() << " reaching defs\n";
+
+    for (const IR_Instr &instr: block.instrs) {
+      std::string dest = operand_text(function, instr.dest);
+      std::string left = operand_text(function, instr.left);
+      std::string right = operand_text(function, instr.right);
+
+      out << "  ";
+
+      switch (instr.op) {
+        case IR_COPY: out << dest << " = " << left; break;
+        case IR_ADD: out << dest << " = " << left << " + " << right; break;
+        case IR_SUB: out << dest << " = " << left << " - " << right; break;
+        case IR_MULT: out << dest << " = " << left << " * " << right; break;
+        case IR_DIV: out << dest << " = " << left << " / " << right; break;
+        case IR_NEG: out << dest << " = -" << left; break;
+        case IR_READ: out << "read " << dest; break;
+        case IR_WRITE: out << "write " << left; break;
+        case IR_JUMP: out << "goto " << block_name(instr.target); break;
+        case IR_BRANCH:
+          out << "if " << left << " " << relation_text(instr.relation) << " " << right
+            << " goto " << block_name(instr.target) << " else " << block_name(instr.other);
+          break;
+        case IR_STOP: out << "stop"; break;
+      }
+
+      out << "\n";
+    }
+
+    out << "  ; live out ";
+    print_set(function, live.out[b], out);
+    out << "\n";
+  }
+}
+
+// Branches taken when <left> <relation> <right> holds, or when it fails
+// The accumulator holds left - right, or left * right for %
+void write_relation_branch(Token_Type relation, bool when_true, const std::string &label) {
+  if (relation == TK_GREATER_THAN) {
+    write_asm(when_true ? "BRPOS" : "BRZNEG", label);
+  }
+  else if (relation == TK_LESS_THAN) {
+    write_asm(when_true ? "BRNEG" : "BRZPOS", label);
+  }
+  else if (relation == TK_EQUALS_EQUALS) {
+    if (when_true) {
+      write_asm("BRZERO", label);
+    }
+    else {
+      write_asm("BRPOS", label);
+      write_asm("BRNEG", label);
+    }
+  }
+  else if (relation == TK_L_BRACE) {
+    if (when_true) {
+      write_asm("BRPOS", label);
+      write_asm("BRNEG", label);
+    }
+    else {
+      write_asm("BRZERO", label);
+    }
+  }
+  else {
+    write_asm(when_true ? "BRZPOS" : "BRNEG", label);
+  }
+}
+
+// Lower the IR to accumulator assembly in the code generation buffer
+// Blocks are laid out in order, jumps to the next block fall through
+void lower_ir(const IR_Function &function) {
+  reset_semantics();
+
+  // Blocks reached by something other than falling into them
+  std::vector<bool> labeled(function.blocks.size(), false);
+
+  for (unsigned int b = 0; b < function.blocks.size(); b++) {
+    const IR_Instr &last = function.blocks[b].instrs.back();
+
+    if (last.op == IR_JUMP && last.target != b + 1) {
+      labeled[last.target] = true;
+    }
+
+    // One side of a branch can fall through, the other needs a label
+    if (last.op == IR_BRANCH) {
+      if (last.target != b + 1) { labeled[last.target] = true; }
+      if (last.other != b + 1) { labeled[last.other] = true; }
+    }
+  }
+
+  // Spare temp for writing constants, WRITE takes storage only
+  std::string write_temp = "T" + std::to_string(function.temp_count);
+  bool uses_write_temp = false;
+
+  bool stopped = false;
+
+  for (unsigned int b = 0; b < function.blocks.size(); b++) {
+    if (labeled[b]) {
+      write_asm(block_name(b) + ":", "NOOP");
+    }
+
+    for (const IR_Instr &instr: function.blocks[b].instrs) {
+      std::string dest = operand_text(function, instr.dest);
+      std::string left = operand_text(function, instr.left);
+      std::string right = operand_text(function, instr.right);
+
+      stopped = false;
+
+      switch (instr.op) {
+        case IR_COPY:
+          write_asm("LOAD", left);
+          write_asm("STORE", dest);
+          break;
+        case IR_ADD:
+        case IR_SUB:
+        case IR_MULT:
+        case IR_DIV: {
+          const char *ops[] = { "ADD", "SUB", "MULT", "DIV" };
+
+          write_asm("LOAD", left);
+          write_asm(ops[instr.op - IR_ADD], right);
+          write_asm("STORE", dest);
+          break;
+        }
+        case IR_NEG:
+          write_asm("LOAD", left);
+          write_asm("MULT", "-1");
+          write_asm("STORE", dest);
+          break;
+        case IR_READ:
+          write_asm("READ", dest);
+          break;
+        case IR_WRITE:
+          if (instr.left.type == IR_CONST) {
+            write_asm("LOAD", left);
+            write_asm("STORE", write_temp);
+            left = write_temp;
+            uses_write_temp = true;
+          }
+
+          write_asm("WRITE", left);
+          break;
+        case IR_JUMP:
+          if (instr.target != b + 1) {
+            write_asm("BR", block_name(instr.target));
+          }
+          break;
+        case IR_BRANCH:
+          write_asm("LOAD", left);
+          write_asm(instr.relation == TK_PERCENT ? "MULT" : "SUB", right);
+
+          // Branch away on whichever side does not come next
+          if (instr.target == b + 1) {
+            write_relation_branch(instr.relation, false, block_name(instr.other));
+          }
+          else {
+            write_relation_branch(instr.relation, true, block_name(instr.target));
+
+            if (instr.other != b + 1) {
+              write_asm("BR", block_name(instr.other));
+            }
+          }
+          break;
+        case IR_STOP:
+          write_asm("STOP");
+          stopped = true;
+          break;
+      }
+    }
+  }
+
+  // A program ending in a jump still needs STOP before storage
+  if (!stopped) {
+    write_asm("STOP");
+  }
+
+  get_asm_lines().push_back("");
+
+  for (const IR_Var &var: function.vars) {
+    write_asm(var.name, std::to_string(var.is_global ? var.initial : 0));
+  }
+
+  for (unsigned int t = 0; t < function.temp_count; t++) {
+    write_asm("T" + std::to_string(t), "0");
+  }
+
+  if (uses_write_temp) {
+    write_asm(write_temp, "0");
+  }
+
+  clean_control_flow();
+  track_accumulator();
+}
@@ -0,0 +1,149 @@
+#ifndef IR_H
+#define IR_H
+
+#include <ostream>
+#include <string>
+#include <vector>
+
+#include "node.h"
+
+// Three address IR between the tree and the accumulator assembly
+// Every operand is a constant, a source variable or a compiler temp
+
+enum IR_Operand_Type {
+  IR_NONE,
+  IR_CONST,
+  IR_VAR,
+  IR_TEMP
+};
+
+struct IR_Operand {
+  IR_Operand_Type type;
+
+  // Constant value, or index into the variable or temp table
+  int value;
+
+  IR_Operand() {
+    this->type = IR_NONE;
+    this->value = 0;
+  }
+
+  IR_Operand(IR_Operand_Type type, int value) {
+    this->type = type;
+    this->value = value;
+  }
+};
+
+enum IR_Op {
+  IR_COPY,    // dest = left
+  IR_ADD,     // dest = left + right
+  IR_SUB,     // dest = left - right
+  IR_MULT,    // dest = left * right
+  IR_DIV,     // dest = left / right
+  IR_NEG,     // dest = -left
+  IR_READ,    // read dest
+  IR_WRITE,   // write left
+
+  // Terminators, one at the end of every basic block
+  IR_JUMP,    // goto target
+  IR_BRANCH,  // if left <relation> right goto target else other
+  IR_STOP
+};
+
+struct IR_Instr {
+  IR_Op op;
+
+  IR_Operand dest;
+  IR_Operand left;
+  IR_Operand right;
+
+  // <RO> of a branch, and the blocks it can go to
+  Token_Type relation;
+  unsigned int target;
+  unsigned int other;
+
+  IR_Instr(IR_Op op = IR_STOP) {
+    this->op = op;
+    this->relation = TK_EOF;
+    this->target = 0;
+    this->other = 0;
+  }
+};
+
+// Straight line instructions ending in a terminator
+struct IR_Block {
+  std::vector<IR_Instr> instrs;
+
+  std::vector<unsigned int> succs;
+  std::vector<unsigned int> preds;
+};
+
+// Source variable, scoped names are made unique (x, x_1, ...)
+struct IR_Var {
+  std::string name;
+  int initial;
+  bool is_global;
+};
+
+// Whole program, block 0 is the entry
+struct IR_Function {
+  std::vector<IR_Block> blocks;
+  std::vector<IR_Var> vars;
+  unsigned int temp_count;
+
+  IR_Function() {
+    this->temp_count = 0;
+  }
+};
+
+// Fixed size set of bits for dataflow facts
+struct Bit_Set {
+  std::vector<unsigned long long> words;
+
+  Bit_Set(unsigned int size = 0) {
+    this->words.assign((size + 63) / 64, 0);
+  }
+
+  void set(unsigned int bit) { words[bit / 64] |= 1ULL << (bit % 64); }
+  void reset(unsigned int bit) { words[bit / 64] &= ~(1ULL << (bit % 64)); }
+  bool test(unsigned int bit) const { return (words[bit / 64] >> (bit % 64)) & 1ULL; }
+  unsigned int count() const;
+
+  // Union in place, true if anything was added
+  bool merge(const Bit_Set &);
+};
+
+// Facts on entry and exit of every block
+struct Dataflow_Result {
+  std::vector<Bit_Set> in;
+  std::vector<Bit_Set> out;
+};
+
+// Sorted definition numbers, only a few of the program's definitions reach any block
+typedef std::vector<unsigned int> Def_Set;
+
+// Definitions reaching the entry and exit of every block
+struct Reaching_Defs {
+  // (block, instruction) of each definition, numbered in program order
+  std::vector<std::pair<unsigned int, unsigned int>> defs;
+
+  std::vector<Def_Set> in;
+  std::vector<Def_Set> out;
+};
+
+// Building, analysis and lowering
+void build_ir(Node *, IR_Function &);
+void build_cfg(IR_Function &);
+void remove_unreachable(IR_Function &);
+
+Dataflow_Result solve_dataflow(const IR_Function &, bool, unsigned int,
+    const std::vector<Bit_Set> &, const std::vector<Bit_Set> &);
+Dataflow_Result compute_liveness(const IR_Function &);
+Reaching_Defs compute_reaching_defs(const IR_Function &);
+
+unsigned int remove_dead_assignments(IR_Function &);
+
+void print_ir(const IR_Function &, std::ostream &);
+void lower_ir(const IR_Function &);
+
+#endif
@@ -0,0 +1,128 @@
+#include <algorithm>
+
+#include "labels.h"
+
+void Label_Table::clear() {
+  labels.clear();
+  waiting.clear();
+  scope_names.clear();
+  scope_orders.clear();
+  jump_count = 0;
+}
+
+void Label_Table::open_scope() {
+  scope_names.push_back(std::vector<std::string>());
+  scope_orders.push_back(jump_count);
+}
+
+// Labels of the block go away, jumps out of it keep waiting
+void Label_Table::close_scope() {
+  for (const std::string &name: scope_names.back()) {
+    auto found = labels.find(name);
+    found->second.pop_back();
+
+    if (found->second.empty()) {
+      labels.erase(found);
+    }
+  }
+
+  scope_names.pop_back();
+  scope_orders.pop_back();
+}
+
+bool Label_Table::define(const std::string &name, unsigned int target, std::vector<unsigned int> &resolved) {
+  unsigned int level = scope_names.size();
+  std::vector<Label> &defined = labels[name];
+
+  if (!defined.empty() && defined.back().level == level) {
+    return false;
+  }
+
+  defined.push_back({ target, level });
+  scope_names.back().push_back(name);
+
+  // Jumps made since the block opened are the ones inside it, always the newest
+  auto found = waiting.find(name);
+
+  if (found != waiting.end()) {
+    std::vector<Jump> &jumps = found->second;
+
+    while (!jumps.empty() && jumps.back().order >= scope_orders.back()) {
+      resolved.push_back(jumps.back().site);
+      jumps.pop_back();
+    }
+
+    if (jumps.empty()) {
+      waiting.erase(found);
+    }
+  }
+
+  return true;
+}
+
+bool Label_Table::jump(const std::string &name, unsigned int site, unsigned int &target) {
+  auto found = labels.find(name);
+
+  if (found != labels.end()) {
+    target = found->second.back().target;
+    return true;
+  }
+
+  waiting[name].push_back({ site, jump_count++ });
+  return false;
+}
+
+void Label_Table::take_escaping(std::vector<std::pair<std::string, std::vector<unsigned int>>> &escaping) {
+  std::vector<std::pair<unsigned int, std::string>> oldest;
+
+  for (auto &entry: waiting) {
+    std::vector<Jump> &jumps = entry.second;
+    unsigned int first = jumps.size();
+
+    while (first > 0 && jumps[first - 1].order >= scope_orders.back()) {
+      first--;
+    }
+
+    if (first < jumps.size()) {
+      oldest.push_back(std::make_pair(jumps[first].order, entry.first));
+    }
+  }
+
+  // Same order every compile, whatever the hash order
+  std::sort(oldest.begin(), oldest.end());
+
+  for (auto &entry: oldest) {
+    auto found = waiting.find(entry.second);
+    std::vector<Jump> &jumps = found->second;
+    std::vector<unsigned int> sites;
+
+    while (!jumps.empty() && jumps.back().order >= scope_orders.back()) {
+      sites.insert(sites.begin(), jumps.back().site);
+      jumps.pop_back();
+    }
+
+    if (jumps.empty()) {
+      waiting.erase(found);
+    }
+
+    escaping.push_back(std::make_pair(entry.second, sites));
+  }
+}
+
+bool Label_Table::first_waiting(std::string &name, unsigned int &site) const {
+  bool any = false;
+  unsigned int oldest = 0;
+
+  for (auto &entry: waiting) {
+    const Jump &jump = entry.second.front();
+
+    if (!any || jump.order < oldest) {
+      any = true;
+      oldest = jump.order;
+      name = entry.first;
+      site = jump.site;
+    }
+  }
+
+  return any;
+}
@@ -0,0 +1,60 @@
+#ifndef LABELS_H
+#define LABELS_H
+
+#include <string>
+#include <unordered_map>
+#include <utility>
+#include <vector>
+
+// User labels of the open blocks, hashed by name
+// A label is visible from anywhere in its block, so a jump to a name with
+// no label yet waits until one appears in a block that still holds the jump
+// Targets and jump sites are plain indices the caller gives meaning to
+struct Label_Table {
+  struct Label {
+    unsigned int target;
+    unsigned int level;
+  };
+
+  struct Jump {
+    unsigned int site;
+    unsigned int order;
+  };
+
+  // Visible labels with each name, innermost last
+  std::unordered_map<std::string, std::vector<Label>> labels;
+
+  // Jumps still waiting on each name, oldest first
+  std::unordered_map<std::string, std::vector<Jump>> waiting;
+
+  // Names each open block defined, and how many jumps came before it opened
+  std::vector<std::vector<std::string>> scope_names;
+  std::vector<unsigned int> scope_orders;
+
+  unsigned int jump_count;
+
+  Label_Table() {
+    this->jump_count = 0;
+  }
+
+  void clear();
+  void open_scope();
+  void close_scope();
+
+  // Add a label to the innermost block, false if it already has one by that name
+  // Sites of the waiting jumps it settles are added to resolved
+  bool define(const std::string &, unsigned int, std::vector<unsigned int> &);
+
+  // Target of the innermost visible label, otherwise the site waits and false
+  bool jump(const std::string &, unsigned int, unsigned int &);
+
+  // Take the jumps still waiting from inside the innermost block, by name, oldest first
+  void take_escaping(std::vector<std::pair<std::string, std::vector<unsigned int>>> &);
+
+  bool has_waiting() const { return !waiting.empty(); }
+
+  // Oldest jump that never found its label, false if there is none
+  bool first_waiting(std::string &, unsigned int &) const;
+};
+
+#endif
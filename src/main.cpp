@@ -8,17 +8,25 @@
 
 #include <iostream>
 #include <fstream>
+#include <sstream>
 #include <string>
 #include <cstdlib>
 #include <stdio.h>
+#include <vector>
 
-#include "parser.h"
+#include "compfs.h"
+#include "options.h"
+#include "stream.h"
 #include "tree_traversal.h"
-#include "runtime_semantics.h"
+#include "watch.h"
 
 void create_file_from_input(std::string, bool);
 void attempt_to_open_file(std::ofstream &, std::string);
 void load_input_fp(std::ifstream &, std::string);
+bool parse_option(std::string);
+void set_base_filename(std::string);
+void compile_base_file();
+void compile_changed_file(const std::string &);
 
 void cleanup();
 
@@ -33,13 +41,58 @@ std::string base_filename;
 int main(int argc, char *argv[]) {
   // Strings for input and output base filenames
 
+  // Options start with --, anything else is the file
+  std::vector<std::string> args;
+
+  for (int i = 1; i < argc; i++) {
+    std::string arg = argv[i];
+
+    if (arg.compare(0, 2, "--") != 0) {
+      args.push_back(arg);
+    }
+    else if (!parse_option(arg)) {
+      std::cout << "Unknown option: " << arg << ". Exiting.\n" << std::endl;
+      exit(EXIT_FAILURE);
+    }
+  }
+
+  // Streaming never holds the whole tree, so nothing can look at it
+  if (compile_options.stream && (compile_options.via_ir || compile_options.dump_ir || compile_options.dump_ast != AST_NONE)) {
+    std::cout << "--stream cannot be combined with --via-ir, --dump-ir or --dump-ast. Exiting.\n" << std::endl;
+    exit(EXIT_FAILURE);
+  }
+
+  // Only direct generation of the whole tree keeps where its lines came from
+  if (compile_options.source_map && (compile_options.stream || compile_options.via_ir)) {
+    std::cout << "--source-map cannot be combined with --stream or --via-ir. Exiting.\n" << std::endl;
+    exit(EXIT_FAILURE);
+  }
+
+  // Threads only split up direct generation of the whole tree
+  if (compile_options.codegen_threads > 1 && (compile_options.stream || compile_options.via_ir)) {
+    std::cout << "--codegen-threads cannot be combined with --stream or --via-ir. Exiting.\n" << std::endl;
+    exit(EXIT_FAILURE);
+  }
+
+  // Watch a directory, recompiling each source saved in it until interrupted
+  if (compile_options.watch) {
+    if (args.size() != 1) {
+      std::cout << "--watch takes exactly one directory. Exiting.\n" << std::endl;
+      exit(EXIT_FAILURE);
+    }
+
+    watch_directory(args[0], compile_changed_file);
+
+    return 0;
+  }
+
   // Before doing anything make sure no excess params
-  if (argc > 2) {
+  if (args.size() > 1) {
     std::cout << "Excess arguments given. Exiting.\n" << std::endl;
     exit(EXIT_FAILURE);
   }
   // No input file, read from keyboard
-  else if (argc == 1) {
+  else if (args.empty()) {
     std::cout << "No file provided. Taking input (CTRL-D to end): " << std::endl;
 
     // Set default file and create it with data inputted
@@ -47,42 +100,53 @@ int main(int argc, char *argv[]) {
     create_file_from_input(base_filename + INPUT_FILE_SUFFIX, true);
   }
   // Input file provided
-  else if (argc == 2) {
-    /* std::cout << "File provided. Verifying. " << std::endl; */
-
-    // Take the arg and store it
-    base_filename = argv[1];
-
-    int file_length = base_filename.length();
-
-    // If it has an extension
-    // .fl2021 will be 7 chars + 1 letter
-    // If it has a dot, then it is a wrong length for an extension
-    // Given that 8 will be the minimum
-    if (base_filename.find(".") != std::string::npos) {
-      /* std::cout << base_filename << " " << file_length << std::endl; */
-
-      // By this point it has a dot and should be at least 8 chars
-      if (base_filename.find("fl2021") != std::string::npos) {
-        if (file_length < 8) {
-          std::cout << "File is missing a name for this extension.\n" << std::endl;
-          exit(EXIT_FAILURE);
-        }
-      }
-      // Otherwise it is an incorrect format that does not contain it
-      else {
-        std::cout << "File is an incorrect format. Requires *.fl2021 if provided.\n" << std::endl;
+  else {
+    set_base_filename(args[0]);
+  }
+
+  compile_base_file();
+
+  return 0;
+}
+
+// Strip the implied .fl2021 ending from a file argument into base_filename
+void set_base_filename(std::string arg) {
+  // Take the arg and store it
+  base_filename = arg;
+
+  int file_length = base_filename.length();
+
+  // If it has an extension
+  // .fl2021 will be 7 chars + 1 letter
+  // If it has a dot, then it is a wrong length for an extension
+  // Given that 8 will be the minimum
+  if (base_filename.find(".") != std::string::npos) {
+    /* std::cout << base_filename << " " << file_length << std::endl; */
+
+    // By this point it has a dot and should be at least 8 chars
+    if (base_filename.find("fl2021") != std::string::npos) {
+      if (file_length < 8) {
+        std::cout << "File is missing a name for this extension.\n" << std::endl;
         exit(EXIT_FAILURE);
       }
-
-      // Substring removal of file ending since it is implied in program
-      size_t last_index = base_filename.find_last_of(".");
-      base_filename = base_filename.substr(0, last_index);
     }
-    // Otherwise it doesn't contain any file ending, so it is implied to add the extension
-    // Which will work out on the build_tree() process
+    // Otherwise it is an incorrect format that does not contain it
+    else {
+      std::cout << "File is an incorrect format. Requires *.fl2021 if provided.\n" << std::endl;
+      exit(EXIT_FAILURE);
+    }
+
+    // Substring removal of file ending since it is implied in program
+    size_t last_index = base_filename.find_last_of(".");
+    base_filename = base_filename.substr(0, last_index);
   }
+  // Otherwise it doesn't contain any file ending, so it is implied to add the extension
+  // Which will work out on the build_tree() process
+}
 
+// Compile base_filename + .fl2021 into base_filename + .asm
+// Errors exit the program
+void compile_base_file() {
   // Construct the entire filename into designated format
   // *.fl2021
   const std::string FINAL_INPUT_FILENAME = base_filename + INPUT_FILE_SUFFIX;
@@ -91,40 +155,74 @@ int main(int argc, char *argv[]) {
   std::ifstream temp_in_fp;
   load_input_fp(temp_in_fp, FINAL_INPUT_FILENAME);
 
-  // Begin parser
-  Node *root = parser(temp_in_fp);
+  // Parse and generate one top level statement at a time
+  if (compile_options.stream) {
+    const std::string FINAL_OUTPUT_FILENAME = base_filename + OUTPUT_FILE_SUFFIX;
+
+    stream_compile(temp_in_fp, FINAL_OUTPUT_FILENAME);
+
+    std::cout << "\nTarget File Generated: " << FINAL_OUTPUT_FILENAME << std::endl;
 
-  if (root == nullptr) {
-    std::cout << "Parser failed to load data." << std::endl;
+    temp_in_fp.close();
     cleanup();
 
-    exit(EXIT_FAILURE);
+    std::cout << std::endl;
+
+    return;
   }
 
-  /* // Use preorder traversal once complete */
-  /* std::cout << "\nOutputting Pre-Order Traversal" << std::endl; */
-  /* print_pre_order(root); */
+  // Whole source in memory for the compiler library
+  std::stringstream source;
+  source << temp_in_fp.rdbuf();
+  temp_in_fp.close();
+
+  const std::string SOURCE_TEXT = source.str();
+
+  Compile_Result result = compile(SOURCE_TEXT.data(), SOURCE_TEXT.size(), compile_options);
+
+  // Dumps were made on the way to any error, so they go first
+  std::cout << result.listing;
+
+  for (const Diagnostic &diagnostic: result.diagnostics) {
+    std::cout << diagnostic.message;
+  }
+
+  std::cout << std::flush;
+
+  if (!result.succeeded) {
+    exit(EXIT_FAILURE);
+  }
 
   const std::string FINAL_OUTPUT_FILENAME = base_filename + OUTPUT_FILE_SUFFIX;
 
   // Create and verify file can be used
-  create_file_from_input(FINAL_OUTPUT_FILENAME, false);
+  std::ofstream out_fp;
+  attempt_to_open_file(out_fp, FINAL_OUTPUT_FILENAME);
+
+  out_fp << result.assembly;
+  out_fp.close();
 
-  // Begin Code Generation
-  initialize_semantics(root, FINAL_OUTPUT_FILENAME);
+  if (compile_options.source_map) {
+    std::ofstream map_fp;
+    attempt_to_open_file(map_fp, FINAL_OUTPUT_FILENAME + ".map");
+
+    map_fp << result.source_map;
+    map_fp.close();
+  }
 
   // Output name of target generated and nothing else on success
   std::cout << "\nTarget File Generated: " << FINAL_OUTPUT_FILENAME << std::endl;
 
-  // Close temp streams
-  temp_in_fp.close();
-
   cleanup();
 
   // Just for exit formatting
   std::cout << std::endl;
+}
 
-  return 0;
+// Recompile a source saved in a watched directory, named as if it were the argument
+void compile_changed_file(const std::string &filename) {
+  set_base_filename(filename);
+  compile_base_file();
 }
 
 
@@ -185,6 +283,90 @@ void load_input_fp(std::ifstream &temp, std::string filename) {
   }
 }
 
+// Store a --name=value option, false if it is not one
+bool parse_option(std::string arg) {
+  size_t equals = arg.find("=");
+
+  std::string name = arg.substr(0, equals);
+  std::string value = (equals == std::string::npos) ? "" : arg.substr(equals + 1);
+
+  // --unroll-budget=N, largest estimated size of an unrolled loop
+  if (name == "--unroll-budget") {
+    if (value.empty() || value.size() > 9 || value.find_first_not_of("0123456789") != std::string::npos) {
+      return false;
+    }
+
+    compile_options.unroll_budget = std::stoul(value);
+    return true;
+  }
+
+  // --codegen-threads=N, threads generating the top level statements
+  if (name == "--codegen-threads") {
+    if (value.empty() || value.size() > 3 || value.find_first_not_of("0123456789") != std::string::npos
+        || std::stoul(value) == 0) {
+      return false;
+    }
+
+    compile_options.codegen_threads = std::stoul(value);
+    return true;
+  }
+
+  // --dump-ast=text|json|dot, print the parsed tree
+  if (name == "--dump-ast") {
+    return parse_ast_format(value, compile_options.dump_ast);
+  }
+
+  // --dump-ir, print the IR with its CFG and dataflow facts
+  if (arg == "--dump-ir") {
+    compile_options.dump_ir = true;
+    return true;
+  }
+
+  // --via-ir, generate code by lowering the IR
+  if (arg == "--via-ir") {
+    compile_options.via_ir = true;
+    return true;
+  }
+
+  // --no-select, lower every operator through a temp as before
+  if (arg == "--no-select") {
+    compile_options.select_patterns = false;
+    return true;
+  }
+
+  // --no-optimize, generate the tree as parsed
+  if (arg == "--no-optimize") {
+    compile_options.tree_passes = false;
+    return true;
+  }
+
+  // --stream, parse and generate one top level statement at a time
+  if (arg == "--stream") {
+    compile_options.stream = true;
+    return true;
+  }
+
+  // --source-map, write where each instruction came from next to the target
+  if (arg == "--source-map") {
+    compile_options.source_map = true;
+    return true;
+  }
+
+  // --watch, recompile sources as they are saved in the directory given
+  if (arg == "--watch") {
+    compile_options.watch = true;
+    return true;
+  }
+
+  // --scan-thread, scan on its own thread ahead of the parser
+  if (arg == "--scan-thread") {
+    compile_options.scan_thread = true;
+    return true;
+  }
+
+  return false;
+}
+
 // Remove temp file
 void cleanup() {
   // Delete the temp file for input if it was created from keyboard
@@ -17,20 +17,39 @@ struct Node {
   Node(std::string label, unsigned int depth) {
     this->func_label = label;
     this->depth = depth;
+    this->op = TK_EOF;
+    this->value = 0;
+    this->line = 0;
   }
 
   // Store label of BNF function and depth
   std::string func_label;
   unsigned int depth;
 
+  // Semantic payload only, the parser checks punctuation and keywords and drops them
+  // Expressions only get a node for an operator or operand, parentheses build none
+  // <expr> <N> <A>: the operator, over both operands
+  // <M>: TK_PERIOD, over the negated operand
+  // <R>: TK_ID or TK_INT, no children
+  // <RO>: the relation, {==} is kept as TK_L_BRACE
+  // <vars> <in> <assign> <label> <goto>: TK_ID
+  // Every other node keeps no token, TK_EOF
+  Token_Type op;
+
+  // Integer of <R> and initial value of <vars>
+  int value;
+
+  // Source line of the payload, or of the keyword starting a <stat>
+  unsigned int line;
+
+  // Identifier of <R>, <vars>, <in>, <assign>, <label> and <goto>
+  std::string symbol;
+
   // Use vector to avoid having to resize arrays
   // Point to children
   // Since vector, no max size
   std::vector<Node *> children;
 
-  // Store or dispose tokens consumed
-  std::vector<Token> consumed_tokens;
-
 // Use vector chains
 /*   // Binary Tree */
 /*   Node *left; */
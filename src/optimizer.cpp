@@ -0,0 +1,989 @@
+#include <climits>
+#include <map>
+#include <set>
+#include <string>
+#include <vector>
+
+#include "optimizer.h"
+#include "parser.h"
+
+// Counted loops running longer than this are left alone
+const unsigned int MAX_TRIP_COUNT = 100000;
+
+// Annotations on the tree this thread optimized
+// Threads generating code for it read their caller's instead
+static thread_local Tree_Annotations own_annotations;
+static thread_local Tree_Annotations *annotations = &own_annotations;
+
+// Variable values known between the top level statements of a streamed program
+static thread_local Known_Values stream_known;
+
+// Run every tree pass before code generation
+// Passes only unlink nodes, anything declaring into the current scope stays
+void optimize_tree(Node *root) {
+  if (root == nullptr) { return; }
+
+  // <program> -> <vars> program <block>
+  fold_conditions(root->children[1]);
+  eliminate_dead_code(root->children[1], true);
+
+  // Dead stores leave variables behind that are never used
+  eliminate_unused_vars(root);
+
+  // Trip counts for loop unrolling during code generation
+  find_counted_loops(root);
+
+  // Repeated expressions within straight line statements
+  find_common_exprs(root);
+}
+
+// Read an integer literal, false if it does not fit the machine word
+bool parse_integer(const std::string &text, int &value) {
+  long long result = 0;
+
+  for (char c: text) {
+    result = result * 10 + (c - '0');
+
+    if (result > INT_MAX) { return false; }
+  }
+
+  value = (int) result;
+  return true;
+}
+
+// Fold an expression made only of integers, matching the code generation
+// <expr>, <N> and <A> are right recursive, so a - b - c is a - (b - c)
+// Identifiers fold too when given a map of their known values
+bool fold_constant(Node *root, int &value, const Known_Values *known) {
+  if (root == nullptr) { return false; }
+
+  std::string label = root->func_label;
+
+  // Identifier | Integer
+  if (label == "<R>") {
+    if (root->op == TK_INT) {
+      value = root->value;
+      return true;
+    }
+
+    if (known != nullptr && known->count(root->symbol) != 0) {
+      value = known->at(root->symbol);
+      return true;
+    }
+
+    return false;
+  }
+
+  // <M> -> . <M>
+  if (label == "<M>") {
+    if (!fold_constant(root->children[0], value, known)) { return false; }
+
+    value = -value;
+    return true;
+  }
+
+  int left;
+  int right;
+
+  if (!fold_constant(root->children[0], left, known) || !fold_constant(root->children[1], right, known)) {
+    return false;
+  }
+
+  long long result;
+  Token_Type op = root->op;
+
+  if (op == TK_PLUS) {
+    result = (long long) left + right;
+  }
+  else if (op == TK_MINUS) {
+    result = (long long) left - right;
+  }
+  else if (op == TK_STAR) {
+    result = (long long) left * right;
+  }
+  // Leave division by zero for the machine to report
+  else if (op == TK_SLASH && right != 0) {
+    result = (long long) left / right;
+  }
+  else {
+    return false;
+  }
+
+  // Keep results the machine word can hold
+  if (result > INT_MAX || result < INT_MIN) { return false; }
+
+  value = (int) result;
+  return true;
+}
+
+// Same tests write_RO() branches on
+bool evaluate_RO(Token_Type tk, int left, int right) {
+  long long difference = (long long) left - right;
+
+  if (tk == TK_GREATER_THAN) { return difference > 0; }
+  if (tk == TK_LESS_THAN) { return difference < 0; }
+  if (tk == TK_EQUALS_EQUALS) { return difference == 0; }
+  if (tk == TK_L_BRACE) { return difference != 0; }
+
+  // % is true when signs match, 0 counting as both
+  return (long long) left * right >= 0;
+}
+
+// Fold [ <expr> <RO> <expr> ] of an <if> or <loop>
+bool fold_condition(Node *root, bool &result) {
+  int left;
+  int right;
+
+  if (!fold_constant(root->children[0], left) || !fold_constant(root->children[2], right)) {
+    return false;
+  }
+
+  result = evaluate_RO(root->children[1]->op, left, right);
+  return true;
+}
+
+// Labels outside of a nested <block> can be jumped to from the rest of the enclosing one
+// Removing one would leave those jumps without a target
+bool exposes_label(Node *node) {
+  if (node == nullptr || node->func_label == "<block>") { return false; }
+  if (node->func_label == "<label>") { return true; }
+
+  for (Node *child: node->children) {
+    if (exposes_label(child)) { return true; }
+  }
+
+  return false;
+}
+
+// Check if a subtree holds a node with the given label
+bool contains_node(Node *node, const std::string &label) {
+  if (node == nullptr) { return false; }
+  if (node->func_label == label) { return true; }
+
+  for (Node *child: node->children) {
+    if (contains_node(child, label)) { return true; }
+  }
+
+  return false;
+}
+
+// Check if a subtree reads, writes or redeclares an identifier
+bool mentions(Node *node, const std::string &name) {
+  if (node == nullptr) { return false; }
+
+  std::string label = node->func_label;
+
+  if (label == "<R>" && node->op == TK_ID
+      && node->symbol == name) {
+    return true;
+  }
+
+  if ((label == "<in>" || label == "<assign>" || label == "<vars>")
+      && node->symbol == name) {
+    return true;
+  }
+
+  for (Node *child: node->children) {
+    if (mentions(child, name)) { return true; }
+  }
+
+  return false;
+}
+
+// Check if a subtree uses an identifier as a variable
+// Only <R>, <in> and <assign> refer to a declaration
+bool references(Node *node, const std::string &name) {
+  if (node == nullptr) { return false; }
+
+  std::string label = node->func_label;
+
+  if (label == "<R>" && node->op == TK_ID
+      && node->symbol == name) {
+    return true;
+  }
+
+  if ((label == "<in>" || label == "<assign>")
+      && node->symbol == name) {
+    return true;
+  }
+
+  for (Node *child: node->children) {
+    if (references(child, name)) { return true; }
+  }
+
+  return false;
+}
+
+// Flatten a <stats> chain into the slots holding each <stat>
+// Clearing a slot removes the statement, empty slots are skipped by codegen
+void collect_stats(Node *stats, std::vector<Node **> &slots) {
+  // <stats> -> <stat> <m_stat>, <m_stat> -> empty | <stat> <m_stat>
+  while (stats != nullptr) {
+    slots.push_back(&stats->children[0]);
+    stats = stats->children[1];
+  }
+}
+
+// The node a <stat> wraps
+Node *statement_kind(Node *stat) {
+  if (stat == nullptr || stat->children.empty()) { return nullptr; }
+
+  return stat->children[0];
+}
+
+// Replace <if> and <loop> statements whose condition folds to a constant
+// A false <loop> never runs, a true one is left alone
+void fold_conditions(Node *&node) {
+  if (node == nullptr) { return; }
+
+  for (Node *&child: node->children) {
+    fold_conditions(child);
+  }
+
+  Node *kind = statement_kind(node);
+  if (node->func_label != "<stat>" || kind == nullptr) { return; }
+
+  bool result;
+
+  // <if> -> if [ <expr> <RO> <expr> ] then <stat> [else <stat>]
+  if (kind->func_label == "<if>" && fold_condition(kind, result)) {
+    Node *then_stat = kind->children[3];
+    Node *else_stat = kind->children.size() == 5 ? kind->children[4] : nullptr;
+
+    Node *kept = result ? then_stat : else_stat;
+    Node *dropped = result ? else_stat : then_stat;
+
+    if (!exposes_label(dropped)) {
+      node = kept;
+    }
+  }
+  // <loop> -> while [ <expr> <RO> <expr> ] <stat>
+  else if (kind->func_label == "<loop>" && fold_condition(kind, result)) {
+    if (!result && !exposes_label(kind->children[3])) {
+      node = nullptr;
+    }
+  }
+}
+
+// Check if a statement list overwrites a variable before reading it
+// Anything unclear counts as a read
+bool is_dead_store(std::vector<Node **> &slots, unsigned int from, const std::string &name, bool dies_at_end) {
+  for (unsigned int i = from; i < slots.size(); i++) {
+    Node *stat = *slots[i];
+    if (stat == nullptr) { continue; }
+
+    // Control flow could come back around to a read
+    if (contains_node(stat, "<label>") || contains_node(stat, "<goto>")) {
+      return false;
+    }
+
+    Node *kind = statement_kind(stat);
+
+    // Overwritten without being read first
+    if (kind->func_label == "<assign>" && kind->symbol == name) {
+      return !mentions(kind->children[0], name);
+    }
+
+    if (kind->func_label == "<in>" && kind->symbol == name) {
+      return true;
+    }
+
+    if (mentions(stat, name)) {
+      return false;
+    }
+  }
+
+  return dies_at_end;
+}
+
+// Remove unreachable statements and dead stores in every <block>
+// <block> -> start <vars> <stats> stop
+void eliminate_dead_code(Node *node, bool is_program_block) {
+  if (node == nullptr) { return; }
+
+  if (node->func_label != "<block>") {
+    for (Node *child: node->children) {
+      eliminate_dead_code(child, false);
+    }
+
+    return;
+  }
+
+  // Variables declared here go away with the block
+  std::set<std::string> locals;
+
+  for (Node *vars = node->children[0]; vars != nullptr; vars = vars->children[0]) {
+    locals.insert(vars->symbol);
+  }
+
+  std::vector<Node **> slots;
+  collect_stats(node->children[1], slots);
+
+  // Statements after a jump are skipped until the next label
+  bool unreachable = false;
+
+  for (unsigned int i = 0; i < slots.size(); i++) {
+    Node *stat = *slots[i];
+    if (stat == nullptr) { continue; }
+
+    if (unreachable) {
+      if (contains_node(stat, "<label>")) {
+        unreachable = false;
+      }
+      else {
+        *slots[i] = nullptr;
+        continue;
+      }
+    }
+
+    if (statement_kind(stat)->func_label == "<goto>") {
+      unreachable = true;
+    }
+  }
+
+  // Values that are overwritten or never read again
+  // At the end of the program every variable is dead
+  // Removing a store can kill the one before it, so repeat until stable
+  bool changed = true;
+
+  while (changed) {
+    changed = false;
+
+    for (unsigned int i = 0; i < slots.size(); i++) {
+      Node *stat = *slots[i];
+      if (stat == nullptr) { continue; }
+
+      Node *kind = statement_kind(stat);
+      if (kind->func_label != "<assign>") { continue; }
+
+      // Leave a store that could divide by zero for the machine to report
+      if (has_unsafe_division(kind->children[0])) { continue; }
+
+      std::string name = kind->symbol;
+      bool dies_at_end = is_program_block || locals.count(name) != 0;
+
+      if (is_dead_store(slots, i + 1, name, dies_at_end)) {
+        *slots[i] = nullptr;
+        changed = true;
+      }
+    }
+  }
+
+  // Nested blocks inside the remaining statements
+  for (unsigned int i = 0; i < slots.size(); i++) {
+    eliminate_dead_code(*slots[i], false);
+  }
+}
+
+// Unlink declarations from a <vars> chain that nothing in scope refers to
+// Shadowed uses count as uses, duplicates are kept for push() to report
+void drop_unused(Node **slot, Node *scope) {
+  std::set<std::string> seen;
+  std::set<std::string> duplicates;
+
+  for (Node *vars = *slot; vars != nullptr; vars = vars->children[0]) {
+    std::string name = vars->symbol;
+
+    if (seen.count(name) != 0) {
+      duplicates.insert(name);
+    }
+
+    seen.insert(name);
+  }
+
+  // <vars> -> empty | declare Identifier = Integer ; <vars>
+  while (*slot != nullptr) {
+    Node *vars = *slot;
+    std::string name = vars->symbol;
+
+    if (duplicates.count(name) == 0 && !references(scope, name)) {
+      *slot = vars->children[0];
+    }
+    else {
+      slot = &vars->children[0];
+    }
+  }
+}
+
+// Drop declarations that are never read or written
+// Nothing is pushed for them, so check_vars() offsets of the rest close up
+void eliminate_unused_vars(Node *node) {
+  if (node == nullptr) { return; }
+
+  // <program> -> <vars> program <block>
+  if (node->func_label == "<program>") {
+    drop_unused(&node->children[0], node->children[1]);
+  }
+  // <block> -> start <vars> <stats> stop
+  else if (node->func_label == "<block>") {
+    drop_unused(&node->children[0], node->children[1]);
+  }
+
+  for (Node *child: node->children) {
+    eliminate_unused_vars(child);
+  }
+}
+
+// Names a loop body may change: assigned, read in, or redeclared
+// Redeclared names mean a different variable inside the body
+void loop_writes(Node *node, std::set<std::string> &writes) {
+  if (node == nullptr) { return; }
+
+  std::string label = node->func_label;
+
+  if (label == "<assign>" || label == "<in>" || label == "<vars>") {
+    writes.insert(node->symbol);
+  }
+
+  for (Node *child: node->children) {
+    loop_writes(child, writes);
+  }
+}
+
+// An expression is invariant if none of its identifiers are written
+bool is_invariant(Node *node, const std::set<std::string> &writes) {
+  if (node == nullptr) { return true; }
+
+  if (node->func_label == "<R>" && node->op == TK_ID
+      && writes.count(node->symbol) != 0) {
+    return false;
+  }
+
+  for (Node *child: node->children) {
+    if (!is_invariant(child, writes)) { return false; }
+  }
+
+  return true;
+}
+
+// Check if an expression costs more than a single load
+bool has_operator(Node *node) {
+  if (node == nullptr) { return false; }
+
+  // <R> is the operand itself, everything else applies an operator
+  return node->func_label != "<R>";
+}
+
+// Check if evaluating an expression early could divide by zero
+// Only divisors that fold to a non zero constant are safe
+bool has_unsafe_division(Node *node) {
+  if (node == nullptr) { return false; }
+
+  if (node->func_label == "<N>" && node->op == TK_SLASH) {
+    int divisor;
+
+    if (!fold_constant(node->children[1], divisor) || divisor == 0) {
+      return true;
+    }
+  }
+
+  for (Node *child: node->children) {
+    if (has_unsafe_division(child)) { return true; }
+  }
+
+  return false;
+}
+
+// Check if an expression is nothing but the given variable
+bool is_variable(Node *node, const std::string &name) {
+  return node != nullptr && node->func_label == "<R>"
+    && node->op == TK_ID
+    && node->symbol == name;
+}
+
+// Count the statements that may write a variable, redeclarations included
+unsigned int count_writes(Node *node, const std::string &name) {
+  if (node == nullptr) { return 0; }
+
+  unsigned int count = 0;
+  std::string label = node->func_label;
+
+  if ((label == "<assign>" || label == "<in>" || label == "<vars>")
+      && node->symbol == name) {
+    count++;
+  }
+
+  for (Node *child: node->children) {
+    count += count_writes(child, name);
+  }
+
+  return count;
+}
+
+// Match i + C, C + i or i - C where C is constant for the whole loop
+bool induction_step(Node *node, const std::string &name, const std::set<std::string> &writes,
+    const Known_Values &known, int &step) {
+  if (node == nullptr || node->func_label == "<R>") { return false; }
+
+  Token_Type op = node->op;
+  Node *left = node->children[0];
+  Node *right = node->children[1];
+
+  int value;
+
+  // <expr> -> <N> + <expr>
+  if (node->func_label == "<expr>" && op == TK_PLUS) {
+    if (is_variable(left, name) && is_invariant(right, writes) && fold_constant(right, value, &known)) {
+      step = value;
+      return true;
+    }
+
+    if (is_variable(right, name) && is_invariant(left, writes) && fold_constant(left, value, &known)) {
+      step = value;
+      return true;
+    }
+  }
+  // <A> -> <M> - <A>
+  else if (node->func_label == "<A>" && op == TK_MINUS) {
+    if (is_variable(left, name) && is_invariant(right, writes) && fold_constant(right, value, &known)) {
+      step = -value;
+      return true;
+    }
+  }
+
+  return false;
+}
+
+// Last statement a loop body runs on every pass
+Node *last_statement(Node *body) {
+  Node *kind = statement_kind(body);
+  if (kind == nullptr || kind->func_label != "<block>") { return kind; }
+
+  std::vector<Node **> slots;
+  collect_stats(kind->children[1], slots);
+
+  for (unsigned int i = slots.size(); i > 0; i--) {
+    if (*slots[i - 1] != nullptr) {
+      return statement_kind(*slots[i - 1]);
+    }
+  }
+
+  return nullptr;
+}
+
+// Step the counter until the condition fails, as the machine would
+void count_trips(Node *loop, bool counter_left, int start, int limit, int step) {
+  Token_Type op = loop->children[1]->op;
+
+  long long value = start;
+  unsigned int trips = 0;
+
+  while (counter_left ? evaluate_RO(op, value, limit) : evaluate_RO(op, limit, value)) {
+    if (trips == MAX_TRIP_COUNT) { return; }
+
+    trips++;
+    value += step;
+
+    // The machine would wrap, leave it to run
+    if (value > INT_MAX || value < INT_MIN) { return; }
+  }
+
+  annotations->trip_counts[loop] = trips;
+}
+
+// Record the trip count of while [ i <RO> n ] loops whose body ends in assign i = i + C
+// i must have a known value on entry and no other writes in the body
+void count_loop(Node *loop, const Known_Values &known) {
+  Node *body = loop->children[3];
+
+  // Jumps could skip the step or enter mid body
+  if (contains_node(body, "<label>") || contains_node(body, "<goto>")) { return; }
+
+  std::set<std::string> writes;
+  loop_writes(body, writes);
+
+  // [<expr>, <RO>, <expr>, <stat>], the counter may be on either side
+  for (int side = 0; side < 2; side++) {
+    Node *counter = loop->children[side == 0 ? 0 : 2];
+    Node *limit_expr = loop->children[side == 0 ? 2 : 0];
+
+    if (counter->func_label != "<R>" || counter->op != TK_ID) { continue; }
+
+    std::string name = counter->symbol;
+
+    auto start = known.find(name);
+    if (start == known.end()) { continue; }
+
+    int limit;
+    if (!is_invariant(limit_expr, writes) || !fold_constant(limit_expr, limit, &known)) { continue; }
+
+    // assign i = i + C as the final statement and the only write
+    Node *last = last_statement(body);
+    int step;
+
+    if (last == nullptr || last->func_label != "<assign>"
+        || last->symbol != name
+        || count_writes(body, name) != 1
+        || !induction_step(last->children[0], name, writes, known, step)) {
+      continue;
+    }
+
+    count_trips(loop, side == 0, start->second, limit, step);
+    return;
+  }
+}
+
+// Forget the values of anything a subtree may write
+void forget_writes(Node *node, Known_Values &known) {
+  std::set<std::string> writes;
+  loop_writes(node, writes);
+
+  for (const std::string &name: writes) {
+    known.erase(name);
+  }
+}
+
+// Declarations start out with their literal value
+void declare_known(Node *vars, Known_Values &known) {
+  // <vars> -> empty | declare Identifier = Integer ; <vars>
+  for (; vars != nullptr; vars = vars->children[0]) {
+    known[vars->symbol] = vars->value;
+  }
+}
+
+// Follow the known variable values through a <stat>, counting loops on the way
+void track_statement(Node *stat, Known_Values &known) {
+  Node *kind = statement_kind(stat);
+  if (kind == nullptr) { return; }
+
+  std::string label = kind->func_label;
+
+  // <assign> -> assign Identifier = <expr>
+  if (label == "<assign>") {
+    std::string name = kind->symbol;
+    int value;
+
+    if (fold_constant(kind->children[0], value, &known)) {
+      known[name] = value;
+    }
+    else {
+      known.erase(name);
+    }
+  }
+  // <in> -> listen Identifier
+  else if (label == "<in>") {
+    known.erase(kind->symbol);
+  }
+  // <block> -> start <vars> <stats> stop
+  else if (label == "<block>") {
+    Known_Values inner = known;
+    declare_known(kind->children[0], inner);
+
+    std::vector<Node **> slots;
+    collect_stats(kind->children[1], slots);
+
+    for (Node **slot: slots) {
+      track_statement(*slot, inner);
+    }
+
+    forget_writes(kind, known);
+  }
+  // <if> -> if [ <expr> <RO> <expr> ] then <stat> [else <stat>]
+  else if (label == "<if>") {
+    for (unsigned int i = 3; i < kind->children.size(); i++) {
+      Known_Values branch = known;
+      track_statement(kind->children[i], branch);
+    }
+
+    forget_writes(kind, known);
+  }
+  // <loop> -> while [ <expr> <RO> <expr> ] <stat>
+  else if (label == "<loop>") {
+    count_loop(kind, known);
+
+    // Later passes through the body see whatever it wrote
+    Known_Values inner = known;
+    forget_writes(kind->children[3], inner);
+    track_statement(kind->children[3], inner);
+
+    forget_writes(kind, known);
+  }
+
+  // A jump to a label can arrive with any values
+  if (contains_node(kind, "<label>")) {
+    known.clear();
+  }
+}
+
+// Find loops with a trip count known at compile time
+void find_counted_loops(Node *root) {
+  annotations->trip_counts.clear();
+
+  if (root == nullptr) { return; }
+
+  // <program> -> <vars> program <block>
+  Known_Values known;
+  declare_known(root->children[0], known);
+
+  Node *block = root->children[1];
+
+  std::vector<Node **> slots;
+  collect_stats(block->children[1], slots);
+
+  declare_known(block->children[0], known);
+
+  for (Node **slot: slots) {
+    track_statement(*slot, known);
+  }
+}
+
+// Forget annotations made for an earlier tree
+void clear_tree_annotations() {
+  annotations->trip_counts.clear();
+  annotations->common_sources.clear();
+  annotations->common_saved.clear();
+}
+
+Tree_Annotations *tree_annotations() {
+  return annotations;
+}
+
+void use_tree_annotations(Tree_Annotations *shared) {
+  annotations = (shared == nullptr) ? &own_annotations : shared;
+}
+
+// Trip count of a loop, if find_counted_loops() could work it out
+bool loop_trip_count(Node *loop, unsigned int &trips) {
+  auto found = annotations->trip_counts.find(loop);
+  if (found == annotations->trip_counts.end()) { return false; }
+
+  trips = found->second;
+  return true;
+}
+
+// Rough instruction count of the code a subtree generates
+unsigned int estimate_size(Node *node) {
+  if (node == nullptr) { return 0; }
+
+  std::string label = node->func_label;
+
+  unsigned int size = 0;
+
+  for (Node *child: node->children) {
+    size += estimate_size(child);
+  }
+
+  // Operand load, or a STORE of the right side plus the operation
+  if (label == "<R>") { return 1; }
+  if (label == "<M>") { return size + 1; }
+  if (label == "<expr>" || label == "<N>" || label == "<A>") { return size + 2; }
+
+  // Declarations load, write, and pop at the end of the block
+  if (label == "<vars>") { return size + 3; }
+  if (label == "<in>") { return 3; }
+  if (label == "<out>") { return size + 2; }
+  if (label == "<assign>") { return size + 1; }
+  if (label == "<goto>") { return 1; }
+  if (label == "<label>") { return 2; }
+
+  // Condition STORE and branches plus the closing labels
+  if (label == "<if>") { return size + 6; }
+
+  // The condition runs twice once the loop is bottom tested
+  if (label == "<loop>") {
+    return size + estimate_size(node->children[0]) + estimate_size(node->children[2]) + 9;
+  }
+
+  return size;
+}
+
+// Text of an expression, equal for expressions computing the same value
+std::string expression_key(Node *node) {
+  // Identifier | Integer
+  if (node->func_label == "<R>") {
+    return node->op == TK_INT ? std::to_string(node->value) : node->symbol;
+  }
+
+  // . <M>
+  if (node->func_label == "<M>") {
+    return "(." + expression_key(node->children[0]) + ")";
+  }
+
+  return "(" + expression_key(node->children[0]) + operator_text(node->op)
+    + expression_key(node->children[1]) + ")";
+}
+
+// Identifiers an expression reads
+void expression_operands(Node *node, std::set<std::string> &operands) {
+  if (node == nullptr) { return; }
+
+  if (node->func_label == "<R>" && node->op == TK_ID) {
+    operands.insert(node->symbol);
+  }
+
+  for (Node *child: node->children) {
+    expression_operands(child, operands);
+  }
+}
+
+// Walk an expression in code generation order, second operand first
+// Anything computed before with the same operands is reused instead
+void number_expression(Node *node, Available_Exprs &available) {
+  if (node == nullptr || node->func_label == "<R>") { return; }
+
+  std::string key = expression_key(node);
+
+  auto found = available.find(key);
+  if (found != available.end()) {
+    annotations->common_sources[node] = found->second.first;
+    annotations->common_saved.insert(found->second.first);
+    return;
+  }
+
+  // <M> -> . <M>, otherwise <expr>, <N> and <A> operators
+  if (node->func_label == "<M>") {
+    number_expression(node->children[0], available);
+  }
+  else {
+    number_expression(node->children[1], available);
+    number_expression(node->children[0], available);
+  }
+
+  // Not worth a temp unless reloading it beats computing it
+  if (estimate_size(node) <= 2) { return; }
+
+  Common_Expr entry;
+  entry.first = node;
+  expression_operands(node, entry.operands);
+
+  available[key] = entry;
+}
+
+// Drop every available expression reading a variable
+void kill_operand(Available_Exprs &available, const std::string &name) {
+  for (auto entry = available.begin(); entry != available.end();) {
+    if (entry->second.operands.count(name) != 0) {
+      entry = available.erase(entry);
+    }
+    else {
+      entry++;
+    }
+  }
+}
+
+// Number the expressions of a statement, anything but talk, assign and listen ends the run
+void number_statement(Node *stat, Available_Exprs &available) {
+  Node *kind = statement_kind(stat);
+  if (kind == nullptr) { return; }
+
+  std::string label = kind->func_label;
+
+  // <out> -> talk <expr>
+  if (label == "<out>") {
+    number_expression(kind->children[0], available);
+    return;
+  }
+
+  // <assign> -> assign Identifier = <expr>
+  if (label == "<assign>") {
+    number_expression(kind->children[0], available);
+    kill_operand(available, kind->symbol);
+    return;
+  }
+
+  // <in> -> listen Identifier
+  if (label == "<in>") {
+    kill_operand(available, kind->symbol);
+    return;
+  }
+
+  // The condition of an <if> runs before anything branches, second <expr> first
+  if (label == "<if>") {
+    number_expression(kind->children[2], available);
+    number_expression(kind->children[0], available);
+  }
+
+  available.clear();
+
+  // Nested statements start runs of their own
+  find_common_exprs(kind);
+}
+
+// Find expressions repeated within straight line runs of statements
+// Labels, jumps, branches, loops and block boundaries end a run
+void find_common_exprs(Node *node) {
+  if (node == nullptr) { return; }
+
+  std::string label = node->func_label;
+
+  if (label == "<program>") {
+    annotations->common_sources.clear();
+    annotations->common_saved.clear();
+  }
+
+  // <block> -> start <vars> <stats> stop
+  if (label == "<block>") {
+    Available_Exprs available;
+
+    std::vector<Node **> slots;
+    collect_stats(node->children[1], slots);
+
+    for (Node **slot: slots) {
+      number_statement(*slot, available);
+    }
+
+    return;
+  }
+
+  // Bodies of <if> and <loop> that are a single statement
+  if (label == "<stat>") {
+    Available_Exprs available;
+    number_statement(node, available);
+    return;
+  }
+
+  for (Node *child: node->children) {
+    find_common_exprs(child);
+  }
+}
+
+// Earlier copy of a repeated expression, nullptr if it is computed here
+Node *common_source(Node *node) {
+  auto found = annotations->common_sources.find(node);
+
+  return found == annotations->common_sources.end() ? nullptr : found->second;
+}
+
+// Check if an expression is reused later and needs its value saved
+bool is_common_saved(Node *node) {
+  return annotations->common_saved.count(node) != 0;
+}
+
+// Check if a subtree reuses an earlier expression
+bool contains_common_source(Node *node) {
+  if (node == nullptr) { return false; }
+  if (annotations->common_sources.count(node) != 0) { return true; }
+
+  for (Node *child: node->children) {
+    if (contains_common_source(child)) { return true; }
+  }
+
+  return false;
+}
+
+// Streaming compilation sees one top level statement at a time
+// Start from the declarations of a <program> whose <block> has no statements yet
+void begin_statement_passes(Node *root) {
+  clear_tree_annotations();
+  stream_known.clear();
+
+  declare_known(root->children[0], stream_known);
+  declare_known(root->children[1]->children[0], stream_known);
+}
+
+// The passes of optimize_tree() that stay within one top level statement
+// Only the known variable values carry over to the next one
+void optimize_statement(Node *&stat) {
+  clear_tree_annotations();
+
+  fold_conditions(stat);
+  if (stat == nullptr) { return; }
+
+  eliminate_dead_code(stat, false);
+  eliminate_unused_vars(stat);
+
+  track_statement(stat, stream_known);
+
+  Available_Exprs available;
+  number_statement(stat, available);
+}
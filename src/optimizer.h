@@ -0,0 +1,83 @@
+#ifndef OPTIMIZER_H
+#define OPTIMIZER_H
+
+#include <map>
+#include <set>
+#include <string>
+#include <vector>
+
+#include "node.h"
+
+// Values of variables known at a point in the program
+typedef std::map<std::string, int> Known_Values;
+
+// Expression computed earlier in a run of statements and what it reads
+struct Common_Expr {
+  Node *first;
+  std::set<std::string> operands;
+};
+
+// Available expressions by their text
+typedef std::map<std::string, Common_Expr> Available_Exprs;
+
+// What the passes found for code generation to use, by node
+struct Tree_Annotations {
+  // Loops found to run a known number of times
+  std::map<Node *, unsigned int> trip_counts;
+
+  // Repeated expressions mapped to the earlier copy holding their value
+  // Earlier copies with a later reuse are kept in common_saved
+  std::map<Node *, Node *> common_sources;
+  std::set<Node *> common_saved;
+};
+
+// Run every tree pass before code generation
+void optimize_tree(Node *);
+
+// Passes for a program streamed one top level statement at a time
+void begin_statement_passes(Node *);
+void optimize_statement(Node *&);
+
+// Tree helpers shared by the passes
+bool parse_integer(const std::string &, int &);
+bool fold_constant(Node *, int &, const Known_Values * = nullptr);
+bool exposes_label(Node *);
+bool contains_node(Node *, const std::string &);
+bool mentions(Node *, const std::string &);
+bool references(Node *, const std::string &);
+void collect_stats(Node *, std::vector<Node **> &);
+Node *statement_kind(Node *);
+
+// Dead code and dead store elimination
+void fold_conditions(Node *&);
+void eliminate_dead_code(Node *, bool);
+
+// Unused variable elimination
+void drop_unused(Node **, Node *);
+void eliminate_unused_vars(Node *);
+
+// Loop invariant analysis
+void loop_writes(Node *, std::set<std::string> &);
+bool is_invariant(Node *, const std::set<std::string> &);
+bool has_operator(Node *);
+bool has_unsafe_division(Node *);
+
+// Counted loop analysis for unrolling
+bool is_variable(Node *, const std::string &);
+void find_counted_loops(Node *);
+void clear_tree_annotations();
+
+// Annotations of this thread's tree, and reading another thread's (nullptr for its own)
+Tree_Annotations *tree_annotations();
+void use_tree_annotations(Tree_Annotations *);
+bool loop_trip_count(Node *, unsigned int &);
+unsigned int estimate_size(Node *);
+
+// Common subexpressions within straight line statements
+std::string expression_key(Node *);
+void find_common_exprs(Node *);
+Node *common_source(Node *);
+bool is_common_saved(Node *);
+bool contains_common_source(Node *);
+
+#endif
@@ -0,0 +1,4 @@
+#include "options.h"
+
+// Options of the compile running on this thread, shared by every compile stage
+thread_local Compile_Options compile_options;
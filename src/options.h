@@ -0,0 +1,65 @@
+#ifndef OPTIONS_H
+#define OPTIONS_H
+
+// Formats the parsed tree can be dumped in
+enum Ast_Format {
+  AST_NONE,
+  AST_TEXT,
+  AST_JSON,
+  AST_DOT
+};
+
+// Settings taken from the command line
+struct Compile_Options {
+  // Largest estimated instruction count an unrolled loop may grow to
+  // 0 turns unrolling off
+  unsigned int unroll_budget;
+
+  // Print the three address IR and its CFG to stdout
+  bool dump_ir;
+
+  // Print the parsed tree to stdout in this format
+  Ast_Format dump_ast;
+
+  // Generate code through the IR instead of straight from the tree
+  bool via_ir;
+
+  // Pick expression instructions by pattern instead of one template
+  bool select_patterns;
+
+  // Run the tree passes: dead code, unused variables, unrolling, common subexpressions
+  bool tree_passes;
+
+  // Parse, check and generate one top level statement at a time
+  bool stream;
+
+  // Scan on a separate thread feeding the parser through a token ring
+  bool scan_thread;
+
+  // Threads generating the top level statements, 1 generates in order
+  unsigned int codegen_threads;
+
+  // Write <target>.map, the source line and construct of every instruction
+  bool source_map;
+
+  // Recompile every source saved in a directory instead of one file
+  bool watch;
+
+  Compile_Options() {
+    this->unroll_budget = 64;
+    this->dump_ir = false;
+    this->dump_ast = AST_NONE;
+    this->via_ir = false;
+    this->select_patterns = true;
+    this->tree_passes = true;
+    this->stream = false;
+    this->scan_thread = false;
+    this->codegen_threads = 1;
+    this->source_map = false;
+    this->watch = false;
+  }
+};
+
+extern thread_local Compile_Options compile_options;
+
+#endif
@@ -0,0 +1,350 @@
+#include <algorithm>
+#include <atomic>
+#include <iterator>
+#include <thread>
+#include <unordered_map>
+#include <vector>
+
+#include "parallel_codegen.h"
+#include "optimizer.h"
+#include "options.h"
+#include "runtime_semantics.h"
+#include "tree_visitor.h"
+
+// Run of top level statements generated on a worker thread
+// Temps and labels are numbered from 0, shifted once the part is in place
+struct Part {
+  unsigned int first;
+  unsigned int last;
+
+  std::vector<std::string> lines;
+  std::vector<const Node *> origins;
+  unsigned int temp_count;
+  unsigned int label_count;
+  unsigned int spill_count;
+
+  // A semantic error was held back, the statements are redone in order to report it
+  bool failed;
+};
+
+// Buffer lines of a part once in place, and how far its numbers move
+struct Rebase {
+  unsigned int start;
+  unsigned int end;
+  int temp_shift;
+  int label_shift;
+};
+
+// Parts small enough that the threads can share them out evenly
+const unsigned int PARTS_PER_THREAD = 8;
+
+// State of the compile on the calling thread, workers are handed what they need
+static thread_local std::vector<Node *> top_stats;
+static thread_local std::vector<Part> parts;
+static thread_local std::vector<Rebase> rebases;
+
+// Part each statement belongs to, -1 for statements generated in order
+static thread_local std::vector<int> part_of;
+
+static thread_local unsigned int thread_count;
+static thread_local unsigned int next_stat;
+static thread_local unsigned int parallel_parts;
+static thread_local unsigned int serial_stats;
+
+// Set while a statement is generated in order, its inner <stat>s are not top level
+static thread_local bool inside_stat = false;
+
+// Earlier copies of repeated expressions, and the later ones reusing them
+struct Common_Visitor : public Tree_Visitor<Common_Visitor> {
+  unsigned int stat;
+  std::unordered_map<Node *, unsigned int> saved_in;
+  std::vector<std::pair<Node *, unsigned int>> reused;
+
+  bool pre_visit(Node *node) {
+    if (is_common_saved(node)) {
+      saved_in[node] = stat;
+    }
+
+    Node *source = common_source(node);
+
+    if (source != nullptr) {
+      reused.push_back(std::make_pair(source, stat));
+    }
+
+    return true;
+  }
+};
+
+// Top level <stat>s of the program <block>, in the order they are generated
+void collect_top_stats(Node *root) {
+  top_stats.clear();
+
+  Node *list = root->children[1]->children[1];
+
+  while (list != nullptr) {
+    Node *next = nullptr;
+
+    for (Node *child: list->children) {
+      if (child == nullptr) { continue; }
+
+      if (child->func_label == "<stat>") {
+        top_stats.push_back(child);
+      }
+      else {
+        next = child;
+      }
+    }
+
+    list = next;
+  }
+}
+
+// Split the statements into parts for the threads
+// A temp holding a repeated expression is only known to the statements generated
+// with it, so no cut falls between a copy and its reuse
+// Labels and jumps are matched across the whole program, so statements with them,
+// and any linked to those, are generated in order
+void plan_parts() {
+  unsigned int count = top_stats.size();
+
+  Common_Visitor common;
+
+  for (unsigned int i = 0; i < count; i++) {
+    common.stat = i;
+    common.visit_iterative(top_stats[i]);
+  }
+
+  // Cuts covered by a reuse, as a difference array
+  std::vector<int> covered(count + 1, 0);
+
+  for (auto &entry: common.reused) {
+    unsigned int saved = common.saved_in[entry.first];
+
+    if (saved < entry.second) {
+      covered[saved + 1]++;
+      covered[entry.second + 1]--;
+    }
+  }
+
+  parts.clear();
+  part_of.assign(count, -1);
+
+  unsigned int target = std::max(count / (thread_count * PARTS_PER_THREAD), 1u);
+  unsigned int segment_start = 0;
+  int depth = 0;
+
+  Part part;
+  part.first = 0;
+  part.last = 0;
+
+  for (unsigned int i = 0; i < count; i++) {
+    depth += covered[i + 1];
+
+    // Segment ends when no reuse reaches past it
+    if (depth > 0 && i + 1 < count) { continue; }
+
+    bool in_order = false;
+
+    for (unsigned int s = segment_start; s <= i && !in_order; s++) {
+      in_order = contains_node(top_stats[s], "<label>") || contains_node(top_stats[s], "<goto>");
+    }
+
+    // Statements in order break up the part being built
+    if (in_order) {
+      if (part.last > part.first) {
+        parts.push_back(part);
+      }
+
+      part.first = i + 1;
+      part.last = i + 1;
+      segment_start = i + 1;
+
+      continue;
+    }
+
+    part.last = i + 1;
+    segment_start = i + 1;
+
+    if (part.last - part.first >= target) {
+      parts.push_back(part);
+      part.first = i + 1;
+    }
+  }
+
+  if (part.last > part.first) {
+    parts.push_back(part);
+  }
+
+  for (unsigned int p = 0; p < parts.size(); p++) {
+    for (unsigned int i = parts[p].first; i < parts[p].last; i++) {
+      part_of[i] = p;
+    }
+  }
+
+  parallel_parts = parts.size();
+  serial_stats = std::count(part_of.begin(), part_of.end(), -1);
+}
+
+// Generate every part, each worker takes the next one left
+void run_parts(int var_count) {
+  Scope_Snapshot scope = save_scope();
+  std::atomic<unsigned int> next_part(0);
+
+  // Workers only see their own thread's state, they are handed the caller's
+  std::vector<Part> &shared_parts = parts;
+  std::vector<Node *> &stats = top_stats;
+  Tree_Annotations *annotations = tree_annotations();
+  Compile_Options options = compile_options;
+
+  auto work = [&]() {
+    unsigned int p;
+
+    compile_options = options;
+    use_tree_annotations(annotations);
+
+    while ((p = next_part++) < shared_parts.size()) {
+      Part &part = shared_parts[p];
+
+      load_scope(scope, true);
+
+      for (unsigned int i = part.first; i < part.last; i++) {
+        process_semantics(stats[i], var_count);
+      }
+
+      part.failed = had_deferred_error();
+      part.lines.swap(get_asm_lines());
+      part.origins.swap(get_asm_origins());
+      part.temp_count = get_temp_count();
+      part.label_count = get_label_count();
+      part.spill_count = get_spill_count();
+    }
+
+    reset_semantics();
+  };
+
+  std::vector<std::thread> workers;
+
+  for (unsigned int t = 0; t < std::min(thread_count, (unsigned int) parts.size()); t++) {
+    workers.push_back(std::thread(work));
+  }
+
+  for (std::thread &worker: workers) {
+    worker.join();
+  }
+}
+
+// Move the numbers of every placed part to where generating in order puts them
+void rebase_parts() {
+  std::vector<std::string> &lines = get_asm_lines();
+  std::vector<Rebase> &shared_rebases = rebases;
+  std::atomic<unsigned int> next_rebase(0);
+
+  auto work = [&]() {
+    unsigned int r;
+
+    while ((r = next_rebase++) < shared_rebases.size()) {
+      const Rebase &rebase = shared_rebases[r];
+
+      for (unsigned int i = rebase.start; i < rebase.end; i++) {
+        lines[i] = rebase_line(lines[i], rebase.temp_shift, rebase.label_shift);
+      }
+    }
+  };
+
+  std::vector<std::thread> workers;
+
+  for (unsigned int t = 0; t < std::min(thread_count, (unsigned int) rebases.size()); t++) {
+    workers.push_back(std::thread(work));
+  }
+
+  for (std::thread &worker: workers) {
+    worker.join();
+  }
+}
+
+// Put a generated part in the buffer and claim the temps and labels it used
+void place_part(Part &part) {
+  std::vector<std::string> &lines = get_asm_lines();
+
+  Rebase rebase;
+  rebase.start = lines.size();
+  rebase.temp_shift = get_temp_count();
+  rebase.label_shift = get_label_count();
+
+  lines.insert(lines.end(), std::make_move_iterator(part.lines.begin()), std::make_move_iterator(part.lines.end()));
+  rebase.end = lines.size();
+
+  std::vector<const Node *> &origins = get_asm_origins();
+  origins.insert(origins.end(), part.origins.begin(), part.origins.end());
+
+  if (rebase.temp_shift != 0 || rebase.label_shift != 0) {
+    rebases.push_back(rebase);
+  }
+
+  for (unsigned int i = 0; i < part.temp_count; i++) {
+    generate_temp(VARIABLE);
+  }
+
+  for (unsigned int i = 0; i < part.label_count; i++) {
+    generate_temp(LABEL);
+  }
+
+  reserve_spills(part.spill_count);
+
+  std::vector<std::string>().swap(part.lines);
+  std::vector<const Node *>().swap(part.origins);
+}
+
+// Hook for statements directly in the program <block>
+// The first one starts the threads, each is then placed or generated in order
+void emit_parallel_stat(Node *stat, int var_count) {
+  if (inside_stat) {
+    iterate_children(stat, var_count);
+    return;
+  }
+
+  if (next_stat == 0) {
+    run_parts(var_count);
+  }
+
+  unsigned int i = next_stat++;
+  int p = part_of[i];
+
+  if (p == -1 || parts[p].failed) {
+    inside_stat = true;
+    iterate_children(stat, var_count);
+    inside_stat = false;
+  }
+  else if (parts[p].first == i) {
+    place_part(parts[p]);
+  }
+
+  if (next_stat == top_stats.size()) {
+    rebase_parts();
+  }
+}
+
+void parallel_semantics(Node *root, unsigned int threads, std::string filename) {
+  thread_count = std::max(threads, 1u);
+  next_stat = 0;
+  inside_stat = false;
+  rebases.clear();
+
+  collect_top_stats(root);
+  plan_parts();
+
+  set_stat_hook(emit_parallel_stat);
+  initialize_semantics(root, filename);
+  set_stat_hook(nullptr);
+
+  parts.clear();
+  rebases.clear();
+}
+
+unsigned int get_parallel_parts() {
+  return parallel_parts;
+}
+
+unsigned int get_serial_stats() {
+  return serial_stats;
+}
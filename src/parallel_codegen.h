@@ -0,0 +1,16 @@
+#ifndef PARALLEL_CODEGEN_H
+#define PARALLEL_CODEGEN_H
+
+#include <string>
+
+#include "node.h"
+
+// Code generation with the top level statements of the program <block>
+// split across threads, output is the same for any thread count
+void parallel_semantics(Node *, unsigned int, std::string="");
+
+// Parts generated on threads by the last compile, and statements done in order
+unsigned int get_parallel_parts();
+unsigned int get_serial_stats();
+
+#endif
@@ -1,16 +1,40 @@
+#include <algorithm>
 #include <iostream>
 
+#include <iterator>
 #include <map>
+#include <sstream>
 #include <string>
 
+#include "diagnostics.h"
+#include "options.h"
 #include "parser.h"
+#include "scan_pipeline.h"
 #include "scanner.h"
 
-Token temp_tk;
-std::ifstream *in_fp = nullptr;
+// Parser state is per thread, so sources can be parsed on separate threads at once
+thread_local Token temp_tk;
+thread_local std::istream *in_fp = nullptr;
 
 // Might as well make this unsigned
-unsigned int current_line = 1;
+thread_local unsigned int current_line = 1;
+
+// Optional pre-scanned token lines used instead of the scanner
+// Cursor points at the next token to hand out
+thread_local std::vector<std::vector<Token> > *tk_lines = nullptr;
+thread_local unsigned int tk_line = 0;
+thread_local unsigned int tk_index = 0;
+
+// Told about every token a node consumes, set by the incremental compiler
+thread_local Token_Hook token_hook = nullptr;
+
+// Streamed statements all sit where the first <stat> of the program <block> would
+const int STREAM_DEPTH = 2;
+thread_local unsigned int streamed_stats = 0;
+
+// Every node made while an owner is set, so it can free them all at once
+// Includes nodes a failed parse or the passes left out of the tree
+thread_local std::vector<Node *> *owned_nodes = nullptr;
 
 // Store the string version of Token_Types
 // For printing purposes
@@ -71,25 +95,178 @@ std::map<Token_Type, std::string> token_strings = {
 
 // Fetch the next token from the scanner using the global variables
 void get_next_token(Node *n) {
-  // Store the consumed tokens before getting new one
-  if (n != nullptr) {
-    n->consumed_tokens.push_back(temp_tk);
+  // Nodes keep no tokens, only the hook sees what each one consumed
+  if (n != nullptr && token_hook != nullptr) {
+    token_hook(n, temp_tk);
+  }
+
+  // Pull from the token lines when parsing a pre-scanned source
+  if (tk_lines != nullptr) {
+    temp_tk = next_buffered_token();
+    current_line = temp_tk.line_num;
+
+    return;
+  }
+
+  // Take it from the scanner thread when scanning is pipelined
+  if (scan_thread_running()) {
+    temp_tk = take_scanned_token();
+    current_line = temp_tk.line_num;
+
+    return;
   }
 
   // Fetch new token from scanner using globals
   temp_tk = scanner(*in_fp, current_line);
 }
 
+// Keep the identifier being consumed as the node's symbol
+void keep_symbol(Node *n) {
+  n->op = TK_ID;
+  n->symbol = temp_tk.token_instance;
+  n->line = temp_tk.line_num;
+}
+
+// Keep the operator or relation being consumed
+void keep_operator(Node *n) {
+  n->op = temp_tk.token_ID;
+  n->line = temp_tk.line_num;
+}
+
+// Keep the integer being consumed as the node's value
+// The scanner caps integers at 8 digits, so they always fit
+void keep_integer(Node *n) {
+  n->value = std::stoi(temp_tk.token_instance);
+}
+
+// Spelling of an operator or relation kept on a node
+const char *operator_text(Token_Type op) {
+  switch (op) {
+    case TK_PLUS:           return "+";
+    case TK_MINUS:          return "-";
+    case TK_STAR:           return "*";
+    case TK_SLASH:          return "/";
+    case TK_PERIOD:         return ".";
+    case TK_GREATER_THAN:   return ">";
+    case TK_LESS_THAN:      return "<";
+    case TK_EQUALS_EQUALS:  return "==";
+    case TK_L_BRACE:        return "{==}";
+    case TK_PERCENT:        return "%";
+    default:                return "";
+  }
+}
+
+void set_token_hook(Token_Hook hook) {
+  token_hook = hook;
+}
+
+// Hand out the next token of the token lines, skipping empty lines
+// Running off the end gives an EOF token one line past the source
+Token next_buffered_token() {
+  while (tk_line < tk_lines->size() && tk_index >= (*tk_lines)[tk_line].size()) {
+    tk_line++;
+    tk_index = 0;
+  }
+
+  if (tk_line >= tk_lines->size()) {
+    return Token(TK_EOF, "End of File", tk_lines->size() + 1);
+  }
+
+  Token tk = (*tk_lines)[tk_line][tk_index];
+  tk_index++;
+
+  return tk;
+}
+
+// Parse a whole program from pre-scanned token lines
+Node *parse_tokens(std::vector<std::vector<Token> > &lines) {
+  tk_lines = &lines;
+  tk_line = 0;
+  tk_index = 0;
+
+  get_next_token(nullptr);
+
+  Node *root = program();
+
+  // Needs to end with EOF since it is the base token
+  if (temp_tk.token_ID != TK_EOF) {
+    error(TK_EOF, temp_tk.token_ID);
+  }
+
+  tk_lines = nullptr;
+
+  return root;
+}
+
+// Parse a single <stat> starting at a position of the token lines
+// The token following the statement is left in the lookahead
+// Gives back nullptr if the position does not start a statement
+Node *parse_statement(std::vector<std::vector<Token> > &lines, unsigned int line, unsigned int index, int depth) {
+  tk_lines = &lines;
+  tk_line = line;
+  tk_index = index;
+
+  get_next_token(nullptr);
+
+  Node *root = nullptr;
+
+  if (is_statement_keyword()) {
+    root = stat(depth);
+  }
+
+  tk_lines = nullptr;
+
+  return root;
+}
+
+// Token waiting after the last parse
+Token lookahead_token() {
+  return temp_tk;
+}
+
+// Node for the parser, kept in the owner's list when there is one
+Node *new_node(const std::string &label, unsigned int depth) {
+  Node *node = new Node(label, depth);
+
+  if (owned_nodes != nullptr) {
+    owned_nodes->push_back(node);
+  }
+
+  return node;
+}
+
+// Empty set node dropped by the parser, no longer the owner's to free
+void delete_node(Node *node) {
+  if (owned_nodes != nullptr) {
+    auto found = std::find(owned_nodes->rbegin(), owned_nodes->rend(), node);
+
+    if (found != owned_nodes->rend()) {
+      owned_nodes->erase(std::next(found).base());
+    }
+  }
+
+  delete node;
+}
+
+void own_nodes(std::vector<Node *> *nodes) {
+  owned_nodes = nodes;
+}
+
 // Auxiliary for parser
 // Just the old test scanner with small changes
 // Will not reach this function if it starts off with no data
-Node *parser(std::ifstream &in_stream) {
+Node *parser(std::istream &in_stream) {
   /* std::cout << "\nParsing..." << std::endl; */
 
   // Assign global file pointer from parameter
   in_fp = &in_stream;
+  current_line = 1;
   bool has_data = (in_fp->peek() != EOF);
 
+  if (has_data && compile_options.scan_thread) {
+    start_scan_thread(in_stream, current_line);
+  }
+
   // Create main root
   Node * root = nullptr;
 
@@ -117,17 +294,88 @@ Node *parser(std::ifstream &in_stream) {
   return root;
 }
 
-// Display parser errors and exit program
+// Streaming: the program is read one top level <stat> at a time
+// <program> -> <vars> program <block>, up to the first statement of <block>
+// The <block> holds its <vars> and no <stats>
+Node *parse_program_head(std::istream &in_stream) {
+  in_fp = &in_stream;
+  current_line = 1;
+  streamed_stats = 0;
+
+  if (compile_options.scan_thread) {
+    start_scan_thread(in_stream, current_line);
+  }
+
+  get_next_token(nullptr);
+
+  Node *root = new_node("<program>", 0);
+
+  // <vars>
+  add_child(root, vars(0));
+
+  // program
+  if (temp_tk.token_ID != TK_PROGRAM) {
+    error(TK_PROGRAM, temp_tk.token_ID);
+  }
+
+  get_next_token(root);
+
+  Node *body = new_node("<block>", 1);
+
+  // start
+  if (temp_tk.token_ID != TK_START) {
+    error(TK_START, temp_tk.token_ID);
+  }
+
+  get_next_token(body);
+
+  // <vars>, <stats> come from parse_next_statement()
+  add_child(body, vars(1));
+  add_child(body, nullptr);
+
+  add_child(root, body);
+
+  return root;
+}
+
+// Next top level <stat>, nullptr once the program <block> has no more
+// <stats> needs at least one, so the first is parsed whatever comes
+Node *parse_next_statement() {
+  if (streamed_stats > 0 && !is_statement_keyword()) {
+    return nullptr;
+  }
+
+  streamed_stats++;
+
+  return stat(STREAM_DEPTH);
+}
+
+// stop of the program <block>, then nothing but EOF
+void parse_program_end() {
+  if (temp_tk.token_ID != TK_STOP) {
+    error(TK_STOP, temp_tk.token_ID);
+  }
+
+  get_next_token(nullptr);
+
+  if (temp_tk.token_ID != TK_EOF) {
+    error(TK_EOF, temp_tk.token_ID);
+  }
+}
+
+// Display parser errors and end the compile
 void error(Token_Type valid_tk, Token_Type invalid_tk) {
-  std::cout << "\nParser Error"
+  std::ostringstream message;
+  message << "\nParser Error"
     << "\n\tLine: " << current_line
     << "\n\tExpected Token: " << token_strings[valid_tk]
     << "\n\tReceived Token: " << token_strings[invalid_tk]
     << "\n\t" << token_strings[temp_tk.token_ID]
     << " Instance: " << temp_tk.token_instance
-    << std::endl;
+    << "\n";
 
-  exit(EXIT_FAILURE);
+  report_diagnostic(PARSER_ERROR, current_line, message.str());
+  abort_compile();
 }
 
 // Words from document
@@ -162,7 +410,7 @@ Node *program() {
   unsigned int depth = 0;
 
   // Create sub-root
-  Node *temp = new Node("<program>", depth);
+  Node *temp = new_node("<program>", depth);
 
   // <vars>
   add_child(temp, vars(depth));
@@ -190,7 +438,7 @@ Node *block(int depth) {
   depth++;
 
   // Create sub-root
-  Node *temp = new Node("<block>", depth);
+  Node *temp = new_node("<block>", depth);
 
   // Follow up with valid tokens
   if (temp_tk.token_ID == TK_START) {
@@ -227,7 +475,7 @@ Node *vars(int depth) {
   depth++;
 
   // Create sub-root
-  Node *temp = new Node("<vars>", depth);
+  Node *temp = new_node("<vars>", depth);
 
   // declare
   if (temp_tk.token_ID == TK_DECLARE) {
@@ -235,6 +483,7 @@ Node *vars(int depth) {
 
     // Identifier
     if (temp_tk.token_ID == TK_ID) {
+      keep_symbol(temp);
       get_next_token(temp);
 
       // =
@@ -243,6 +492,7 @@ Node *vars(int depth) {
 
         // Integer
         if (temp_tk.token_ID == TK_INT) {
+          keep_integer(temp);
           get_next_token(temp);
 
           // ;
@@ -278,23 +528,52 @@ Node *vars(int depth) {
   // If not declare then there is no right side expansion
   // Empty set is null
   // return empty node once tree is up
+  delete_node(temp);
+
   return nullptr;
 }
 
-// <expr> -> <N> + <expr> | <N>
-Node *expr(int depth) {
-  // Increment depth for function chain calls
-  depth++;
+// Expression under a statement, depths are set once the operators are known
+Node *expression(int depth) {
+  Node *root = expr(depth);
+  set_depths(root, depth + 1);
 
-  // Create sub-root
-  Node *temp = new Node("<expr>", depth);
+  return root;
+}
 
+// Number an expression subtree from its root down
+void set_depths(Node *root, unsigned int depth) {
+  root->depth = depth;
+
+  for (Node *child: root->children) {
+    set_depths(child, depth + 1);
+  }
+}
+
+// Operator node over a left operand that was parsed before the operator was seen
+// Consumes the operator token
+Node *binary(const std::string &label, Node *left, int depth) {
+  Node *temp = new_node(label, depth);
+
+  keep_operator(temp);
+  get_next_token(temp);
+
+  add_child(temp, left);
+
+  return temp;
+}
+
+// Pass-through productions build no node, an operand or operator stands alone
+// Depths are filled in by expression()
+
+// <expr> -> <N> + <expr> | <N>
+Node *expr(int depth) {
   // <N> in both cases
-  add_child(temp, N(depth));
+  Node *left = N(depth);
 
   // +
   if (temp_tk.token_ID == TK_PLUS) {
-    get_next_token(temp);
+    Node *temp = binary("<expr>", left, depth);
 
     // <expr>
     add_child(temp, expr(depth));
@@ -303,32 +582,17 @@ Node *expr(int depth) {
   }
 
   // Situation where <N> was alone
-  return temp;
+  return left;
 }
 
 // <N> -> <A> / <N> | <A> * <N> | <A>
 Node *N(int depth) {
-  // Increment depth for function chain calls
-  depth++;
-
-  // Create sub-root
-  Node *temp = new Node("<N>", depth);
-
   // <A> in all 3 cases
-  add_child(temp, A(depth));
-
-  // /
-  if (temp_tk.token_ID == TK_SLASH) {
-    get_next_token(temp);
+  Node *left = A(depth);
 
-    // <N>
-    add_child(temp, N(depth));
-
-    return temp;
-  }
-  // *
-  else if (temp_tk.token_ID == TK_STAR) {
-    get_next_token(temp);
+  // / or *
+  if (temp_tk.token_ID == TK_SLASH || temp_tk.token_ID == TK_STAR) {
+    Node *temp = binary("<N>", left, depth);
 
     // <N>
     add_child(temp, N(depth));
@@ -337,23 +601,17 @@ Node *N(int depth) {
   }
 
   // Otherwise it's just <A> alone
-  return temp;
+  return left;
 }
 
 // <A> -> <M> - <A> | <M>
 Node *A(int depth) {
-  // Increment depth for function chain calls
-  depth++;
-
-  // Create sub-root
-  Node *temp = new Node("<A>", depth);
-
   // <M> in both cases
-  add_child(temp, M(depth));
+  Node *left = M(depth);
 
   // -
   if (temp_tk.token_ID == TK_MINUS) {
-    get_next_token(temp);
+    Node *temp = binary("<A>", left, depth);
 
     // <A>
     add_child(temp, A(depth));
@@ -362,66 +620,64 @@ Node *A(int depth) {
   }
 
   // Otherwise it's just <M> alone
-  return temp;
+  return left;
 }
 
 // <M> -> . <M> | <R>
 Node *M(int depth) {
-  // Increment depth for function chain calls
-  depth++;
-
-  // Create sub-root
-  Node *temp = new Node("<M>", depth);
-
   // .
   if (temp_tk.token_ID == TK_PERIOD) {
+    Node *temp = new_node("<M>", depth);
+
+    keep_operator(temp);
     get_next_token(temp);
 
     // <M>
     add_child(temp, M(depth));
-  }
-  // Otherwise it was an <R>
-  else {
-    add_child(temp, R(depth));
+
+    return temp;
   }
 
-  return temp;
+  // Otherwise it was an <R>
+  return R(depth);
 }
 
 // <R> -> ( <expr> ) | Identifier | Integer
+// Parentheses only group, they build no node
 Node *R(int depth) {
-  // Increment depth for function chain calls
-  depth++;
-
-  // Create sub-root
-  Node *temp = new Node("<R>", depth);
-
   // (
   if (temp_tk.token_ID == TK_L_PAREN) {
-    get_next_token(temp);
+    get_next_token(nullptr);
 
     // <expr>
-    add_child(temp, expr(depth));
+    Node *inner = expr(depth);
 
     // )
     if (temp_tk.token_ID == TK_R_PAREN) {
-      get_next_token(temp);
+      get_next_token(nullptr);
 
-      return temp;
+      return inner;
     }
     // Expected )
     else {
       error(TK_R_PAREN, temp_tk.token_ID);
     }
   }
+
+  // Create sub-root
+  Node *temp = new_node("<R>", depth);
+
   // Identifier
-  else if (temp_tk.token_ID == TK_ID) {
+  if (temp_tk.token_ID == TK_ID) {
+    keep_symbol(temp);
     get_next_token(temp);
 
     return temp;
   }
   // Integer
   else if (temp_tk.token_ID == TK_INT) {
+    keep_operator(temp);
+    keep_integer(temp);
     get_next_token(temp);
 
     return temp;
@@ -441,7 +697,7 @@ Node *stats(int depth) {
   depth++;
 
   // Create sub-root
-  Node *temp = new Node("<stats>", depth);
+  Node *temp = new_node("<stats>", depth);
 
   // <stat>
   add_child(temp, stat(depth));
@@ -458,7 +714,7 @@ Node *m_stat(int depth) {
   depth++;
 
   // Create sub-root
-  Node *temp = new Node("<m_stat>", depth);
+  Node *temp = new_node("<m_stat>", depth);
 
   // Have to check if it's a keyword match or just empty
   bool is_valid = is_statement_keyword();
@@ -475,6 +731,8 @@ Node *m_stat(int depth) {
   }
 
   // Otherwise it was an empty set, which is still valid
+  delete_node(temp);
+
   return nullptr;
 }
 
@@ -484,7 +742,10 @@ Node *stat(int depth) {
   depth++;
 
   // Create sub-root
-  Node *temp = new Node("<stat>", depth);
+  Node *temp = new_node("<stat>", depth);
+
+  // Line of the keyword, for the source map
+  temp->line = temp_tk.line_num;
 
   // Check first sets of word above
 
@@ -617,7 +878,8 @@ Node *stat(int depth) {
 
   // If it hits none of the statements than it is an invalid statement first-set
   // Just use error function here once outside of code since too unique words
-  std::cout << "\nParser Error"
+  std::ostringstream message;
+  message << "\nParser Error"
     << "\n\tLine: " << current_line
     << "\n\tExpected Token: Statement Sub-Tokens: "
     << "\n\t\t" << token_strings[TK_LISTEN]   // <in>
@@ -629,9 +891,10 @@ Node *stat(int depth) {
     << "\n\t\t" << token_strings[TK_JUMP]     // <goto>
     << "\n\t\t" << token_strings[TK_LABEL]    // <label>
     << "\n\tReceived Token: " << token_strings[temp_tk.token_ID]
-    << std::endl;
+    << "\n";
 
-  exit(EXIT_FAILURE);
+  report_diagnostic(PARSER_ERROR, current_line, message.str());
+  abort_compile();
 }
 
 // <in> -> listen Identifier
@@ -640,7 +903,7 @@ Node *in(int depth) {
   depth++;
 
   // Create sub-root
-  Node *temp = new Node("<in>", depth);
+  Node *temp = new_node("<in>", depth);
 
   // listen
   if (temp_tk.token_ID == TK_LISTEN) {
@@ -648,6 +911,7 @@ Node *in(int depth) {
 
     // Identifier
     if (temp_tk.token_ID == TK_ID) {
+      keep_symbol(temp);
       get_next_token(temp);
       return temp;
     }
@@ -670,14 +934,14 @@ Node *out(int depth) {
   depth++;
 
   // Create sub-root
-  Node *temp = new Node("<out>", depth);
+  Node *temp = new_node("<out>", depth);
 
   // talk
   if (temp_tk.token_ID == TK_TALK) {
     get_next_token(temp);
 
     // <expr>
-    add_child(temp, expr(depth));
+    add_child(temp, expression(depth));
 
     return temp;
   }
@@ -695,7 +959,7 @@ Node *if_statement(int depth) {
   depth++;
 
   // Create sub-root
-  Node *temp = new Node("<if>", depth);
+  Node *temp = new_node("<if>", depth);
 
   // if
   if (temp_tk.token_ID == TK_IF) {
@@ -706,13 +970,13 @@ Node *if_statement(int depth) {
       get_next_token(temp);
 
       // <expr>
-      add_child(temp, expr(depth));
+      add_child(temp, expression(depth));
 
       // <RO>
       add_child(temp, RO(depth));
 
       // <expr>
-      add_child(temp, expr(depth));
+      add_child(temp, expression(depth));
 
       // ]
       if (temp_tk.token_ID == TK_R_BRACKET) {
@@ -766,7 +1030,7 @@ Node *loop(int depth) {
   depth++;
 
   // Create sub-root
-  Node *temp = new Node("<loop>", depth);
+  Node *temp = new_node("<loop>", depth);
 
   // while
   if (temp_tk.token_ID == TK_WHILE) {
@@ -777,13 +1041,13 @@ Node *loop(int depth) {
       get_next_token(temp);
 
       // <expr>
-      add_child(temp, expr(depth));
+      add_child(temp, expression(depth));
 
       // <RO>
       add_child(temp, RO(depth));
 
       // <expr>
-      add_child(temp, expr(depth));
+      add_child(temp, expression(depth));
 
       // ]
       if (temp_tk.token_ID == TK_R_BRACKET) {
@@ -816,7 +1080,7 @@ Node *assign(int depth) {
   depth++;
 
   // Create sub-root
-  Node *temp = new Node("<assign>", depth);
+  Node *temp = new_node("<assign>", depth);
 
   // <assign>
   if (temp_tk.token_ID == TK_ASSIGN) {
@@ -824,6 +1088,7 @@ Node *assign(int depth) {
 
     // Identifier
     if (temp_tk.token_ID == TK_ID) {
+      keep_symbol(temp);
       get_next_token(temp);
 
       // =
@@ -831,7 +1096,7 @@ Node *assign(int depth) {
         get_next_token(temp);
 
         // <expr>
-        add_child(temp, expr(depth));
+        add_child(temp, expression(depth));
 
         return temp;
       }
@@ -858,28 +1123,32 @@ Node *RO(int depth) {
   depth++;
 
   // Create sub-root
-  Node *temp = new Node("<RO>", depth);
+  Node *temp = new_node("<RO>", depth);
 
   // >
   if (temp_tk.token_ID == TK_GREATER_THAN) {
+    keep_operator(temp);
     get_next_token(temp);
 
     return temp;
   }
   // <
   else if (temp_tk.token_ID == TK_LESS_THAN) {
+    keep_operator(temp);
     get_next_token(temp);
 
     return temp;
   }
   // ==
   else if (temp_tk.token_ID == TK_EQUALS_EQUALS) {
+    keep_operator(temp);
     get_next_token(temp);
 
     return temp;
   }
   // {
   else if (temp_tk.token_ID == TK_L_BRACE) {
+    keep_operator(temp);
     get_next_token(temp);
 
     // ==
@@ -904,6 +1173,7 @@ Node *RO(int depth) {
   }
   // %
   else if (temp_tk.token_ID == TK_PERCENT) {
+    keep_operator(temp);
     get_next_token(temp);
 
     return temp;
@@ -911,13 +1181,15 @@ Node *RO(int depth) {
 
   // If it hits none of the statements than it is an invalid character
   // Just use error function here once outside of code since too many operators
-  std::cout << "\nParser Error"
+  std::ostringstream message;
+  message << "\nParser Error"
     << "\n\tLine: " << current_line
     << "\n\tExpected Token: Relational Operator (> | < | == | { == } | %)"
     << "\n\tReceived Token: " << token_strings[temp_tk.token_ID]
-    << std::endl;
+    << "\n";
 
-  exit(EXIT_FAILURE);
+  report_diagnostic(PARSER_ERROR, current_line, message.str());
+  abort_compile();
 }
 
 // <label> -> label Identifier
@@ -926,7 +1198,7 @@ Node *label(int depth) {
   depth++;
 
   // Create sub-root
-  Node *temp = new Node("<label>", depth);
+  Node *temp = new_node("<label>", depth);
 
   // label
   if (temp_tk.token_ID == TK_LABEL) {
@@ -934,6 +1206,7 @@ Node *label(int depth) {
 
     // Identifier
     if (temp_tk.token_ID == TK_ID) {
+      keep_symbol(temp);
       get_next_token(temp);
 
       return temp;
@@ -956,7 +1229,7 @@ Node *goto_statement(int depth) {
   depth++;
 
   // Create sub-root
-  Node *temp = new Node("<goto>", depth);
+  Node *temp = new_node("<goto>", depth);
 
   // jump
   if (temp_tk.token_ID == TK_JUMP) {
@@ -964,6 +1237,7 @@ Node *goto_statement(int depth) {
 
     // Identifier
     if (temp_tk.token_ID == TK_ID) {
+      keep_symbol(temp);
       get_next_token(temp);
 
       return temp;
@@ -1,7 +1,8 @@
 #ifndef PARSER_H
 #define PARSER_H
 
-#include <fstream>
+#include <istream>
+#include <vector>
 
 #include "token.h"
 #include "node.h"
@@ -9,14 +10,45 @@
 // To assist in <stat> first sets
 bool is_statement_keyword();
 
+// Called with each token a node consumes, punctuation included
+typedef void (*Token_Hook)(Node *, const Token &);
+
 // Cycle tokens
-void get_next_token();
+void get_next_token(Node *);
+void set_token_hook(Token_Hook);
+
+// Semantic payload of the current token
+void keep_symbol(Node *);
+void keep_operator(Node *);
+void keep_integer(Node *);
+const char *operator_text(Token_Type);
+Token next_buffered_token();
 
 // Add child to node
 void add_child(Node *, Node *);
 
+// Allocate every parser node, and keep them in a list while one is given
+Node *new_node(const std::string &, unsigned int);
+void delete_node(Node *);
+void own_nodes(std::vector<Node *> *);
+
 // Auxiliary Function
-Node *parser(std::ifstream&);
+Node *parser(std::istream&);
+
+// Parsing from pre-scanned token lines
+Node *parse_tokens(std::vector<std::vector<Token> > &);
+Node *parse_statement(std::vector<std::vector<Token> > &, unsigned int, unsigned int, int);
+Token lookahead_token();
+
+// Streaming one top level statement at a time
+Node *parse_program_head(std::istream &);
+Node *parse_next_statement();
+void parse_program_end();
+
+// Expression builders for the compact tree
+Node *expression(int);
+void set_depths(Node *, unsigned int);
+Node *binary(const std::string &, Node *, int);
 
 // BNF Functions
 Node *program();
@@ -1,41 +1,117 @@
+#include <algorithm>
+#include <cctype>
+#include <cstdlib>
 #include <iostream>
 #include <fstream>
+#include <map>
+#include <mutex>
+#include <set>
+#include <sstream>
 #include <string>
+#include <unordered_map>
+#include <vector>
 
 #include "runtime_semantics.h"
+#include "diagnostics.h"
+#include "labels.h"
+#include "optimizer.h"
+#include "options.h"
+#include "tree_visitor.h"
 
 // Assume no more than 100 items in a program
 const int MAX_SIZE = 100;
 
+// Generation state below is per thread, so top level statements can be
+// generated on other threads from a copy of the program <block>'s scope
+
 // Store stack of file
-static Token tk_stack[MAX_SIZE];
+static thread_local Token tk_stack[MAX_SIZE];
 
 // Store total variables stored
-static unsigned int total_vars;
+static thread_local unsigned int total_vars;
 
 // Store the base scope of execution
-static unsigned int base_scope;
+static thread_local unsigned int base_scope;
 
 // Store total amount of temp vars
-static unsigned int total_temp_vars;
+static thread_local unsigned int total_temp_vars;
 
 // Store counters for temp labels
-static unsigned int total_temp_labels;
+static thread_local unsigned int total_temp_labels;
+
+// Program level declarations, kept in storage instead of on the stack
+// Name and initial value in declaration order
+static thread_local std::vector<std::pair<std::string, std::string>> global_vars;
 
 // Store stack of temp variables used
-std::string temp_stack[MAX_SIZE];
+// Grows with the program, temps are not bound by the variable stack limit
+static thread_local std::vector<std::string> temp_stack;
+
+// Store how many <block> levels deep the traversal currently is
+static thread_local unsigned int block_level;
+
+// Optional callback for statements directly inside the program <block>
+static thread_local Stat_Hook stat_hook = nullptr;
+
+// Expressions computed ahead of a loop, mapped to the temp holding them
+static thread_local std::map<Node *, std::string> hoisted;
+
+// Temps holding expressions that are reused later in the same statements
+static thread_local std::map<Node *, std::string> common_temps;
+
+// Repeated expression currently being computed for its temp
+static thread_local Node *saving_common = nullptr;
+
+// User labels, kept off the stack in their own namespace
+// A jump ahead of its label is written without a target and patched once the label is seen
+static thread_local Label_Table user_labels;
+
+// Assembly name and stack depth of each visible label, a block drops its own on exit
+static thread_local std::vector<std::string> label_names;
+static thread_local std::vector<unsigned int> label_depths;
+static thread_local std::vector<unsigned int> label_marks;
+
+// Labels in nested blocks are numbered, the same name can be used in a sibling block
+static thread_local unsigned int nested_labels;
+
+// Lines and tokens of jumps to user labels, by site
+static thread_local std::vector<std::pair<unsigned int, Token>> label_jumps;
+
+// Spill slots hold a value only until the instruction that uses it
+// Slot n is taken while n others are in use, so every expression shares them
+static thread_local unsigned int spill_depth;
+static thread_local unsigned int spill_count;
 
 const std::string LABEL_PREFIX = "L_";
 const std::string VARIABLE_PREFIX = "T";
-
-enum temp_type {
-  LABEL,
-  VARIABLE
-};
+const std::string SPILL_PREFIX = "S";
 
 // Store global file for output
-std::string output_filename;
-std::ofstream out_fp;
+static thread_local std::string output_filename;
+static thread_local std::ofstream out_fp;
+
+// Set while a streamed compile is writing its target file
+// Exiting before the end removes the partial file
+static thread_local bool streaming = false;
+static std::once_flag stream_exit_set;
+
+// Labels that ended the lines written so far, put on the next line written
+static thread_local std::vector<std::string> stream_labels;
+
+// Generated labels below this were in parts already written
+static thread_local unsigned int stream_label_base = 0;
+
+// Buffer of assembly lines, written to the file once generation is done
+static thread_local std::vector<std::string> asm_lines;
+
+// Node each buffered line was generated for, only kept for a source map
+// A <stat>, a <vars> declaration, or nullptr outside any of them
+static thread_local std::vector<const Node *> asm_origins;
+static thread_local const Node *current_origin = nullptr;
+
+// Semantic errors are printed here, a thread that defers them only marks them
+static thread_local bool deferring_errors = false;
+static thread_local bool error_deferred = false;
 
 std::string generate_temp(int type) {
   std::string base;
@@ -47,7 +123,11 @@ std::string generate_temp(int type) {
   }
   else if (type == VARIABLE) {
     base += VARIABLE_PREFIX + std::to_string(total_temp_vars);
-    temp_stack[total_temp_vars] = base;
+
+    // Streamed statements reuse the temps of earlier ones
+    if (total_temp_vars == temp_stack.size()) {
+      temp_stack.push_back(base);
+    }
 
     total_temp_vars++;
   }
@@ -55,14 +135,43 @@ std::string generate_temp(int type) {
   return base;
 }
 
-// Helper function to recursively call children
-void iterate_children(std::vector<Node *> children, unsigned int var_count) {
+// Take the next free spill slot
+std::string take_spill() {
+  std::string slot = SPILL_PREFIX + std::to_string(spill_depth);
 
-  for (auto child: children) {
-    if (child != nullptr) {
-      process_semantics(child, var_count);
-    }
+  spill_depth++;
+  spill_count = std::max(spill_count, spill_depth);
+
+  return slot;
+}
+
+// Free a spill slot once its value is used, other operands are left alone
+void release_spill(const std::string &operand) {
+  if (operand.compare(0, SPILL_PREFIX.size(), SPILL_PREFIX) == 0) {
+    spill_depth--;
+  }
+}
+
+// Every node goes through process_semantics, which picks its own child order
+struct Semantics_Visitor : public Tree_Visitor<Semantics_Visitor> {
+  int var_count;
+
+  void visit(Node *node) {
+    process_semantics(node, var_count);
   }
+};
+
+// Helper function to recursively call children
+void iterate_children(Node *root, unsigned int var_count) {
+  Semantics_Visitor visitor;
+  visitor.var_count = var_count;
+
+  visitor.visit_children(root);
+}
+
+// Identifier of a node as a token for the stack
+Token symbol_token(Node *node) {
+  return Token(TK_ID, node->symbol, node->line);
 }
 
 // Find if a variable was declared before usage
@@ -83,29 +192,186 @@ int check_vars(std::string instance) {
   return -1;
 }
 
-// Assist in formatting assembly file
-void write_asm(std::string statement, std::string misc_param="") {
-  out_fp << statement;
+// Check if an identifier is a program level declaration
+bool is_global(std::string instance) {
+  for (unsigned int i = 0; i < global_vars.size(); i++) {
+    if (global_vars[i].first == instance) { return true; }
+  }
+
+  return false;
+}
+
+// Record program level declarations for storage
+// <vars> -> empty | declare Identifier = Integer ; <vars>
+void declare_globals(Node *root) {
+  for (; root != nullptr; root = root->children[0]) {
+    Token temp_tk = symbol_token(root);
+
+    if (is_global(temp_tk.token_instance)) {
+      std::ostringstream message;
+      message << "Semantic Error: Variable declared more than once."
+        << "\n\t Instance: " << temp_tk.token_instance
+        << "\n\t Line: " << temp_tk.line_num
+        << "\n";
+
+      semantic_error(message.str(), temp_tk.line_num);
+    }
+
+    global_vars.push_back(std::make_pair(temp_tk.token_instance, std::to_string(root->value)));
+  }
+}
 
+// Assist in formatting assembly file
+void write_asm(std::string statement, std::string misc_param) {
   // If not empty add extra spacing
   if (misc_param != "") {
-    out_fp << " " << misc_param;
+    statement += " " + misc_param;
+  }
+
+  // Lines are buffered and terminated with a newline on flush
+  asm_lines.push_back(statement);
+
+  if (compile_options.source_map) {
+    asm_origins.push_back(current_origin);
+  }
+}
+
+// Branch to a user label, dropping the locals of any block it leaves
+// Labels defined later are filled in when they are reached
+void write_jump(const std::string &name, Token tk) {
+  unsigned int site = label_jumps.size();
+  unsigned int target;
+
+  if (user_labels.jump(name, site, target)) {
+    for (unsigned int i = label_depths[target]; i < total_vars; i++) {
+      write_asm("POP");
+    }
+
+    label_jumps.push_back(std::make_pair(asm_lines.size(), tk));
+    write_asm("BR", label_names[target]);
+  }
+  else {
+    label_jumps.push_back(std::make_pair(asm_lines.size(), tk));
+    write_asm("BR");
+  }
+}
+
+// Start a scope for a <block>, gives back the enclosing one for close_block()
+unsigned int open_block() {
+  // Keep the enclosing scope so it can be restored on exit
+  unsigned int outer_scope = base_scope;
+
+  // Store scope for current block
+  // Used to remove from stack once scope ends
+  base_scope = total_vars;
+  block_level++;
+  user_labels.open_scope();
+  label_marks.push_back(label_names.size());
+
+  return outer_scope;
+}
+
+// End the scope of a <block>, dropping its locals and labels
+void close_block(unsigned int outer_scope) {
+  // Jumps ahead to a label outside the block still have its locals to drop
+  std::vector<std::pair<std::string, std::vector<unsigned int>>> escaping;
+  unsigned int locals = total_vars - base_scope;
+
+  if (locals > 0) {
+    user_labels.take_escaping(escaping);
+  }
+
+  // Remove a scope level once finished with block
+  pop();
+  user_labels.close_scope();
+
+  label_names.resize(label_marks.back());
+  label_depths.resize(label_marks.back());
+  label_marks.pop_back();
+
+  // Each label jumped to gets a pad that pops the locals and jumps on from the enclosing block
+  if (!escaping.empty()) {
+    std::string after = generate_temp(LABEL);
+    write_asm("BR", after);
+
+    for (auto &entry: escaping) {
+      std::string pad = generate_temp(LABEL);
+
+      for (unsigned int site: entry.second) {
+        asm_lines[label_jumps[site].first] = "BR " + pad;
+      }
+
+      write_asm(pad + ":", "NOOP");
+
+      for (unsigned int i = 0; i < locals; i++) {
+        write_asm("POP");
+      }
+
+      write_jump(entry.first, label_jumps[entry.second.front()].second);
+    }
+
+    write_asm(after + ":", "NOOP");
+  }
+
+  block_level--;
+  base_scope = outer_scope;
+}
+
+// End of the program <block>, STOP and then storage
+void finish_program() {
+  // Every jump has had its whole program to find a label
+  std::string name;
+  unsigned int site;
+
+  if (user_labels.first_waiting(name, site)) {
+    std::ostringstream message;
+    message << "Semantic Error: Usage of undeclared label identifier."
+      << "\n\t Instance: " << name
+      << "\n\t Line: " << label_jumps[site].second.line_num
+      << "\n";
+
+    semantic_error(message.str(), label_jumps[site].second.line_num);
   }
 
-  // Terminate each line with newline
-  out_fp << "\n";
+  // At the end of the traversal, print STOP to target
+  write_asm("STOP");
+
+  // Follow with global variables
+  write_global_vars();
 }
 
 // Assist in writing all global variables/temporaries to assembly file
 void write_global_vars() {
-  out_fp << "\n";
+  // Blank line between program and storage
+  write_asm("");
 
-  for (unsigned int i = 0; i < MAX_SIZE; i++) {
-    if (temp_stack[i] == "") { continue; }
-    else {
-      // "Initialize" variables to 0
-      write_asm(temp_stack[i], "0");
-    }
+  // Globals start out with their declared value
+  for (unsigned int i = 0; i < global_vars.size(); i++) {
+    write_asm(global_vars[i].first, global_vars[i].second);
+  }
+
+  for (unsigned int i = 0; i < temp_stack.size(); i++) {
+    // "Initialize" variables to 0
+    write_asm(temp_stack[i], "0");
+  }
+
+  for (unsigned int i = 0; i < spill_count; i++) {
+    write_asm(SPILL_PREFIX + std::to_string(i), "0");
+  }
+}
+
+// Write every buffered line out to the target file
+void flush_asm() {
+  for (unsigned int i = 0; i < asm_lines.size(); i++) {
+    out_fp << asm_lines[i] << "\n";
+  }
+}
+
+// Leave first <expr> - second <expr> in the accumulator
+// Against an immediate 0 the first <expr> already is the difference
+void write_difference(std::string t_var) {
+  if (t_var != "0") {
+    write_asm("SUB", t_var);
   }
 }
 
@@ -119,21 +385,21 @@ void write_RO(Token_Type tk, std::string t_var, std::string t_label) {
   // 4 - 3 = 1
   // True as long as result > 0
   if (tk == TK_GREATER_THAN) {
-    write_asm("SUB", t_var);
+    write_difference(t_var);
     write_asm("BRZNEG", t_label);
   }
   // < is less than
   // 3 - 4 = 1
   // True as long as result < 0
   else if (tk == TK_LESS_THAN) {
-    write_asm("SUB", t_var);
+    write_difference(t_var);
     write_asm("BRZPOS", t_label);
   }
   // { == } is NOT equal
   // 4 - 4 != 0
   // True as long as result is not 0
   else if (tk == TK_L_BRACE) {
-    write_asm("SUB", t_var);
+    write_difference(t_var);
     write_asm("BRZERO", t_label);
   }
   // == is equal
@@ -141,7 +407,7 @@ void write_RO(Token_Type tk, std::string t_var, std::string t_label) {
   // True as long as result is 0
   // Should only exit on variation where not 0
   else if (tk == TK_EQUALS_EQUALS) {
-    write_asm("SUB", t_var);
+    write_difference(t_var);
     write_asm("BRPOS", t_label);
     write_asm("BRNEG", t_label);
   }
@@ -153,97 +419,1202 @@ void write_RO(Token_Type tk, std::string t_var, std::string t_label) {
     write_asm("MULT", t_var);
     write_asm("BRNEG", t_label);
   }
-}
+}
+
+// Counterpart of write_RO() that branches when the relation holds
+// Used to branch back to the top of a bottom tested loop
+void write_inverse_RO(Token_Type tk, std::string t_var, std::string t_label) {
+  // > is greater than
+  // True as long as result > 0
+  if (tk == TK_GREATER_THAN) {
+    write_difference(t_var);
+    write_asm("BRPOS", t_label);
+  }
+  // < is less than
+  // True as long as result < 0
+  else if (tk == TK_LESS_THAN) {
+    write_difference(t_var);
+    write_asm("BRNEG", t_label);
+  }
+  // { == } is NOT equal
+  // True as long as result is not 0
+  else if (tk == TK_L_BRACE) {
+    write_difference(t_var);
+    write_asm("BRPOS", t_label);
+    write_asm("BRNEG", t_label);
+  }
+  // == is equal
+  // True as long as result is 0
+  else if (tk == TK_EQUALS_EQUALS) {
+    write_difference(t_var);
+    write_asm("BRZERO", t_label);
+  }
+  // % is true when the signs match, a * b >= 0
+  else if (tk == TK_PERCENT) {
+    write_asm("MULT", t_var);
+    write_asm("BRZPOS", t_label);
+  }
+}
+
+// Helper functions to work with stack items
+void push(Token tk) {
+  // Make sure that there is still room in the stack
+  if (total_vars >= MAX_SIZE) {
+    std::ostringstream message;
+    message << "\nSemantic Error: Max number of stack items exceeded. Limit 100. Total Items: "
+      << total_vars
+      << "\n";
+
+    semantic_error(message.str(), tk.line_num);
+    return;
+  }
+
+  // Make sure no duplicate vars are declared in the same scope
+  for (unsigned int current_scope = base_scope; current_scope < total_vars; current_scope++) {
+
+    if (tk_stack[current_scope].token_instance == tk.token_instance) {
+      std::ostringstream message;
+      message << "Semantic Error: There was a variable already declared in this scope. Variable: "
+        << tk.token_instance << " on line " << tk.line_num
+        << "\n";
+
+      semantic_error(message.str(), tk.line_num);
+    }
+  }
+
+  // Push the variable to the global index in stack
+  tk_stack[total_vars] = tk;
+
+  // Output push instances to file
+  write_asm("PUSH");
+
+  // Increment count to resemble total variables in stack
+  total_vars++;
+}
+
+// Remove a token from the stack
+void pop() {
+  // Loop to remove current scope tokens
+  for (unsigned int current_scope = total_vars; current_scope > base_scope; current_scope--) {
+
+    // One less variable is in the stack
+    total_vars--;
+
+    // Output pop instances to file
+    write_asm("POP");
+
+    // Reset the value within
+    tk_stack[current_scope].token_instance = "";
+    tk_stack[current_scope].line_num = 0;
+  }
+}
+
+// Find the index of a token
+int find(Token tk) {
+  // Loop to find token
+  for (unsigned int current_scope = total_vars; current_scope > base_scope; current_scope--) {
+    if (tk.token_instance == tk_stack[current_scope].token_instance) {
+      // Calculate the distance from the top of the stack
+      // Offset by one since arrays start at 0
+      return (total_vars - 1) - current_scope;
+    }
+  }
+
+  // Negative if no match was found
+  return -1;
+}
+
+// Function to help keep track of the current stack at given times
+void print_vars() {
+  for (unsigned int index = 0; index < MAX_SIZE; index++) {
+    if (tk_stack[index].token_instance == "") {
+      std::cout << std::endl;
+      break;
+    }
+
+    // Print out what is inside of the token
+    std::cout << tk_stack[index].token_instance << " ";
+  }
+}
+
+// Clear all generation state so a tree can be compiled more than once
+void reset_semantics() {
+  for (unsigned int index = 0; index < MAX_SIZE; index++) {
+    tk_stack[index] = Token();
+  }
+
+  total_vars = 0;
+  base_scope = 0;
+  block_level = 0;
+  hoisted.clear();
+  common_temps.clear();
+  global_vars.clear();
+  user_labels.clear();
+  label_names.clear();
+  label_depths.clear();
+  label_marks.clear();
+  nested_labels = 0;
+  label_jumps.clear();
+  saving_common = nullptr;
+  spill_depth = 0;
+  spill_count = 0;
+  total_temp_vars = 0;
+  total_temp_labels = 0;
+  stream_label_base = 0;
+
+  temp_stack.clear();
+  asm_lines.clear();
+  asm_origins.clear();
+  current_origin = nullptr;
+}
+
+// Drop loads and stores of values the accumulator already holds
+// Its contents are tracked as the places known to equal it:
+// literals, storage names and stack slots (@k is STACKR k)
+// Labels, branches and READ forget everything
+// Lines are compacted in place, the buffer can be a whole large program
+void track_accumulator() {
+  std::vector<std::string> acc;
+  bool mapped = !asm_origins.empty() && asm_origins.size() == asm_lines.size();
+
+  unsigned int kept = 0;
+  unsigned int index = 0;
+
+  // Program lines end at the blank line before storage
+  for (; index < asm_lines.size() && !asm_lines[index].empty(); index++) {
+    std::string &line = asm_lines[index];
+
+    size_t start = 0;
+    size_t space = line.find(' ');
+
+    // Another path can arrive at a label, the instruction after it still counts
+    if (line[(space == std::string::npos ? line.size() : space) - 1] == ':') {
+      acc.clear();
+
+      start = space + 1;
+      space = line.find(' ', start);
+    }
+
+    size_t op_length = ((space == std::string::npos) ? line.size() : space) - start;
+
+    // Compare the opcode without copying it out
+    auto is_op = [&](const char *op) { return line.compare(start, op_length, op) == 0; };
+
+    bool is_load = is_op("LOAD");
+    bool is_stack = !is_load && (is_op("STACKR") || is_op("STACKW"));
+    bool is_store = !is_load && !is_stack && is_op("STORE");
+
+    if (is_load || is_stack || is_store) {
+      std::string place = (is_stack ? "@" : "") + line.substr(space + 1);
+
+      bool held = std::find(acc.begin(), acc.end(), place) != acc.end();
+      if (held) { continue; }
+
+      // Loads replace the contents, stores add a place holding them
+      if (is_load || line[start + op_length - 1] == 'R') {
+        acc.clear();
+      }
+
+      acc.push_back(place);
+    }
+    // Slots are counted from the top of the stack
+    else if (is_op("PUSH") || is_op("POP")) {
+      int shift = (line[start + 1] == 'U') ? 1 : -1;
+      std::vector<std::string> shifted;
+
+      for (const std::string &place: acc) {
+        if (place[0] != '@') {
+          shifted.push_back(place);
+          continue;
+        }
+
+        int slot = std::stoi(place.substr(1)) + shift;
+
+        if (slot >= 0) {
+          shifted.push_back("@" + std::to_string(slot));
+        }
+      }
+
+      acc.swap(shifted);
+    }
+    else if (!is_op("WRITE") && !is_op("NOOP")) {
+      acc.clear();
+    }
+
+    if (kept != index) {
+      asm_lines[kept] = std::move(line);
+      if (mapped) { asm_origins[kept] = asm_origins[index]; }
+    }
+    kept++;
+  }
+
+  // Storage follows unchanged
+  for (; index < asm_lines.size(); index++) {
+    if (kept != index) {
+      asm_lines[kept] = std::move(asm_lines[index]);
+      if (mapped) { asm_origins[kept] = asm_origins[index]; }
+    }
+    kept++;
+  }
+
+  asm_lines.resize(kept);
+  if (mapped) { asm_origins.resize(kept); }
+}
+
+// Labeled line, branch or STOP, the lines between them are left as they are
+// Labels are numbered, branches keep the number of their target
+struct Flow_Line {
+  std::vector<unsigned int> labels;
+
+  // Buffer line holding the instruction and where it starts after a label
+  unsigned int source;
+  size_t start;
+
+  // Accumulator signs a branch is taken on, 1 negative, 2 zero, 4 positive
+  int signs;
+  unsigned int target;
+
+  // Other instructions still ahead of it since the previous kept line
+  unsigned int plain_before;
+
+  bool is_stop;
+  bool removed;
+};
+
+int branch_signs(const std::string &op) {
+  if (op == "BR") { return 7; }
+  if (op == "BRNEG") { return 1; }
+  if (op == "BRZNEG") { return 3; }
+  if (op == "BRZERO") { return 2; }
+  if (op == "BRPOS") { return 4; }
+  if (op == "BRZPOS") { return 6; }
+
+  return 0;
+}
+
+// Single branch taken on exactly the given signs, empty if there is none
+std::string signs_branch(int signs) {
+  const char *ops[] = { "", "BRNEG", "BRZERO", "BRZNEG", "BRPOS", "", "BRZPOS", "BR" };
+
+  return ops[signs];
+}
+
+// Clean up the branches code generation leaves behind
+// Label NOOPs are folded onto the next instruction and runs of labels merged,
+// branches to a branch go straight to its target, branches to the next line,
+// unused labels and code no path reaches are removed
+// keep_named keeps user labels, for a part of the program later jumps may need
+// BRcc L; BR M; L: becomes the inverse branch to M so the taken path falls through
+void clean_control_flow(bool keep_named) {
+  const unsigned int NOWHERE = -1;
+
+  std::vector<Flow_Line> lines;
+  std::vector<unsigned int> pending;
+
+  // Labels from generate_temp() keep their own number, others are numbered after them
+  std::vector<std::string> names;
+  std::unordered_map<std::string, unsigned int> numbers;
+
+  // Only labels made since the last flushed part can be in the buffer
+  unsigned int generated = total_temp_labels - stream_label_base;
+
+  auto number = [&](const std::string &line, size_t start, size_t length) {
+    bool is_generated = length > LABEL_PREFIX.size() && line.compare(start, LABEL_PREFIX.size(), LABEL_PREFIX) == 0;
+
+    for (size_t i = start + LABEL_PREFIX.size(); is_generated && i < start + length; i++) {
+      is_generated = isdigit(line[i]);
+    }
+
+    if (is_generated) {
+      unsigned int label = std::stoul(line.substr(start + LABEL_PREFIX.size(), length - LABEL_PREFIX.size()));
+      if (label >= stream_label_base && label < total_temp_labels) { return label - stream_label_base; }
+    }
+
+    auto found = numbers.emplace(line.substr(start, length), generated + names.size());
+    if (found.second) { names.push_back(found.first->first); }
+
+    return found.first->second;
+  };
+
+  auto name = [&](unsigned int label) {
+    return (label < generated) ? LABEL_PREFIX + std::to_string(label + stream_label_base) : names[label - generated];
+  };
+
+  // Buffer lines left out of the output
+  std::vector<bool> dropped(asm_lines.size(), false);
+
+  unsigned int plain = 0;
+  unsigned int index = 0;
+
+  // Program lines end at the blank line before storage
+  for (; index < asm_lines.size() && !asm_lines[index].empty(); index++) {
+    const std::string &line = asm_lines[index];
+
+    size_t start = 0;
+    size_t space = line.find(' ');
+
+    // Label, then the instruction it marks
+    if (line[(space == std::string::npos ? line.size() : space) - 1] == ':') {
+      pending.push_back(number(line, 0, space - 1));
+
+      start = space + 1;
+      space = line.find(' ', start);
+    }
+
+    // A NOOP only holds labels for whatever comes next
+    if (line.compare(start, std::string::npos, "NOOP") == 0) {
+      dropped[index] = true;
+      continue;
+    }
+
+    bool is_branch = line.compare(start, 2, "BR") == 0;
+    bool is_stop = line.compare(start, std::string::npos, "STOP") == 0;
+
+    if (!is_branch && !is_stop && pending.empty()) {
+      plain++;
+      continue;
+    }
+
+    Flow_Line flow;
+    flow.source = index;
+    flow.start = start;
+    flow.signs = 0;
+    flow.target = 0;
+    flow.plain_before = plain;
+    flow.is_stop = is_stop;
+    flow.removed = false;
+
+    if (is_branch) {
+      size_t op_length = ((space == std::string::npos) ? line.size() : space) - start;
+
+      flow.signs = branch_signs(line.substr(start, op_length));
+      flow.target = number(line, space + 1, line.size() - space - 1);
+    }
+
+    flow.labels.swap(pending);
+    lines.push_back(std::move(flow));
+
+    plain = 0;
+  }
+
+  // Nothing follows the labels, keep them on a NOOP
+  if (!pending.empty()) {
+    Flow_Line flow;
+    flow.labels.swap(pending);
+    flow.source = NOWHERE;
+    flow.start = 0;
+    flow.signs = 0;
+    flow.target = 0;
+    flow.plain_before = plain;
+    flow.is_stop = false;
+    flow.removed = false;
+    lines.push_back(std::move(flow));
+
+    plain = 0;
+  }
+
+  unsigned int count = lines.size();
+
+  // Line each label is on, and whether anything branches to it
+  unsigned int label_count = generated + names.size();
+
+  std::vector<unsigned int> line_of(label_count);
+  std::vector<bool> used(label_count);
+
+  auto has_label = [](const Flow_Line &line, unsigned int label) {
+    return std::find(line.labels.begin(), line.labels.end(), label) != line.labels.end();
+  };
+
+  // Next line still in the program
+  auto next_line = [&](unsigned int i) {
+    do { i++; } while (i < count && lines[i].removed);
+
+    return i;
+  };
+
+  // Drop the instructions between two buffer lines
+  auto drop_between = [&](unsigned int from, unsigned int to) {
+    for (unsigned int i = from + 1; i < to; i++) { dropped[i] = true; }
+  };
+
+  bool changed = true;
+
+  while (changed) {
+    changed = false;
+
+    line_of.assign(label_count, NOWHERE);
+    for (unsigned int i = 0; i < count; i++) {
+      if (lines[i].removed) { continue; }
+
+      for (unsigned int label: lines[i].labels) { line_of[label] = i; }
+    }
+
+    // Follow branches through branches that are sure to be taken as well
+    // The accumulator does not change between them
+    used.assign(label_count, false);
+
+    for (Flow_Line &line: lines) {
+      if (line.removed || line.signs == 0) { continue; }
+
+      unsigned int to = line_of[line.target];
+
+      for (unsigned int hops = 0; to != NOWHERE && hops < count; hops++) {
+        const Flow_Line &next = lines[to];
+        if ((next.signs & line.signs) != line.signs) { break; }
+
+        unsigned int further = line_of[next.target];
+        if (further == NOWHERE || further == to) { break; }
+
+        to = further;
+      }
+
+      // The first label of a line names it
+      if (to != NOWHERE && line.target != lines[to].labels[0]) {
+        line.target = lines[to].labels[0];
+        changed = true;
+      }
+
+      used[line.target] = true;
+    }
+
+    // Labels that are not from generate_temp()
+    for (unsigned int label = generated; keep_named && label < label_count; label++) {
+      used[label] = true;
+    }
+
+    // Only a label makes code after BR or STOP reachable again
+    bool reachable = true;
+    unsigned int last_source = NOWHERE;
+
+    for (unsigned int i = 0; i < count; i++) {
+      Flow_Line &line = lines[i];
+
+      if (line.removed) { continue; }
+
+      unsigned int before = line.labels.size();
+
+      line.labels.erase(std::remove_if(line.labels.begin(), line.labels.end(),
+        [&](unsigned int label) { return !used[label]; }), line.labels.end());
+
+      changed = changed || line.labels.size() != before;
+
+      if (!reachable && line.plain_before > 0) {
+        drop_between(last_source, line.source == NOWHERE ? index : line.source);
+        line.plain_before = 0;
+        changed = true;
+      }
+
+      reachable = reachable || !line.labels.empty();
+
+      if (!reachable) {
+        line.removed = true;
+        changed = true;
+        continue;
+      }
+
+      reachable = line.signs != 7 && !line.is_stop;
+      last_source = line.source;
+
+      // BRcc L; BR M; L: takes the inverse branch to M instead
+      unsigned int jump = next_line(i);
+      unsigned int after = (jump < count) ? next_line(jump) : count;
+
+      if (line.signs != 0 && !signs_branch(7 - line.signs).empty() && after < count
+          && lines[jump].signs == 7 && lines[jump].plain_before == 0 && lines[jump].labels.empty()
+          && lines[after].plain_before == 0 && has_label(lines[after], line.target)) {
+        line.signs = 7 - line.signs;
+        line.target = lines[jump].target;
+
+        lines[jump].removed = true;
+        changed = true;
+      }
+    }
+
+    // Instructions after the last BR or STOP
+    if (!reachable && plain > 0) {
+      drop_between(last_source, index);
+      plain = 0;
+    }
+
+    // Branches to the line right after them, from the back so pairs of them go too
+    unsigned int next_kept = count;
+
+    for (unsigned int i = count; i > 0; i--) {
+      Flow_Line &line = lines[i - 1];
+
+      if (line.removed) { continue; }
+
+      bool to_next = line.signs != 0 && next_kept < count
+        && lines[next_kept].plain_before == 0 && has_label(lines[next_kept], line.target);
+
+      if (!to_next) {
+        next_kept = i - 1;
+        continue;
+      }
+
+      // Its labels and what came before it now lead into the line after it
+      std::vector<unsigned int> &labels = lines[next_kept].labels;
+      labels.insert(labels.begin(), line.labels.begin(), line.labels.end());
+      lines[next_kept].plain_before = line.plain_before;
+
+      line.removed = true;
+      changed = true;
+    }
+  }
+
+  // Rewrite the program in place, storage follows unchanged
+  unsigned int kept = 0;
+  unsigned int next = 0;
+
+  // Lines written from buffer line i keep its origin
+  bool mapped = !asm_origins.empty() && asm_origins.size() == asm_lines.size();
+
+  auto place = [&](std::string text, unsigned int i) {
+    asm_lines[kept] = std::move(text);
+    if (mapped) { asm_origins[kept] = asm_origins[i]; }
+    kept++;
+  };
+
+  for (unsigned int i = 0; i < asm_lines.size(); i++) {
+    bool is_flow = i < index && next < count && lines[next].source == i;
+    Flow_Line *line = is_flow ? &lines[next++] : nullptr;
+
+    if (i < index && (dropped[i] || (line != nullptr && line->removed))) { continue; }
+
+    // Labels left over from the end of the program
+    while (i == index && next < count) {
+      line = &lines[next++];
+
+      if (!line->removed) {
+        for (unsigned int label: line->labels) { place(name(label) + ": NOOP", i); }
+      }
+    }
+
+    if (is_flow) {
+      // Extra labels only stay when something is left unresolved
+      for (unsigned int l = 1; l < line->labels.size(); l++) {
+        place(name(line->labels[l - 1]) + ": NOOP", i);
+      }
+
+      std::string text = line->labels.empty() ? "" : name(line->labels.back()) + ": ";
+
+      if (line->signs != 0) {
+        text += signs_branch(line->signs) + " " + name(line->target);
+      }
+      else {
+        text += asm_lines[i].substr(line->start);
+      }
+
+      place(std::move(text), i);
+      continue;
+    }
+
+    if (kept != i) {
+      asm_lines[kept] = std::move(asm_lines[i]);
+      if (mapped) { asm_origins[kept] = asm_origins[i]; }
+    }
+    kept++;
+  }
+
+  asm_lines.resize(kept);
+  if (mapped) { asm_origins.resize(kept); }
+
+  // Labels at the end of a part of the program with no storage after it
+  for (; next < count; next++) {
+    if (lines[next].removed) { continue; }
+
+    for (unsigned int label: lines[next].labels) {
+      asm_lines.push_back(name(label) + ": NOOP");
+      if (mapped) { asm_origins.push_back(kept > 0 ? asm_origins[kept - 1] : nullptr); }
+    }
+  }
+}
+
+// Initialize base variables for assembly output
+// An empty filename keeps the output in the line buffer only
+void initialize_semantics(Node * root, std::string filename) {
+  reset_semantics();
+
+  output_filename = filename;
+
+  // Begin recursive chain
+  process_semantics(root);
+
+  clean_control_flow();
+  track_accumulator();
+
+  if (filename != "") {
+    write_output_file(filename);
+
+    if (compile_options.source_map) {
+      write_source_map(filename + ".map");
+    }
+  }
+}
+
+// Remove the target file of a streamed compile that did not finish
+void discard_stream() {
+  if (streaming) {
+    s_cleanup();
+  }
+}
+
+// Streaming: code is generated and written one top level <stat> at a time
+// Open the target file, then the program <block> of a <program> holding only declarations
+void begin_stream(Node *root, std::string filename) {
+  reset_semantics();
+
+  output_filename = filename;
+  out_fp.open(filename);
+
+  // Parser errors exit without cleaning up, the exiting thread checks its own stream
+  std::call_once(stream_exit_set, []() { std::atexit(discard_stream); });
+
+  streaming = true;
+  stream_labels.clear();
+
+  // Globals go straight to storage, no stack traffic at startup
+  declare_globals(root->children[0]);
+
+  open_block();
+  process_semantics(root->children[1]->children[0], 0);
+}
+
+// Generate one top level <stat>, its tree can be freed once this returns
+void stream_statement(Node *stat) {
+  process_semantics(stat, 0);
+
+  // Nothing outlives the statement but its code, temps start over
+  hoisted.clear();
+  common_temps.clear();
+  saving_common = nullptr;
+  total_temp_vars = 0;
+
+  // Lines of a jump still waiting on its label have to stay in the buffer
+  if (!user_labels.has_waiting()) {
+    flush_stream();
+  }
+}
+
+// Clean up and write out the buffered lines
+// User labels stay, a later jump may still need them
+void flush_stream() {
+  clean_control_flow(true);
+  track_accumulator();
+
+  // Labels at the very end mark whatever the next statement starts with
+  unsigned int end = asm_lines.size();
+
+  while (end > 0 && asm_lines[end - 1].size() > 6
+      && asm_lines[end - 1].compare(asm_lines[end - 1].size() - 6, 6, ": NOOP") == 0) {
+    end--;
+  }
+
+  for (unsigned int i = 0; i < end; i++) {
+    const std::string &line = asm_lines[i];
+
+    if (i == 0 && !stream_labels.empty()) {
+      size_t space = line.find(' ');
+      bool labeled = line[(space == std::string::npos ? line.size() : space) - 1] == ':';
+
+      for (unsigned int l = 0; l < stream_labels.size(); l++) {
+        if (l + 1 < stream_labels.size() || labeled) {
+          out_fp << stream_labels[l] << ": NOOP\n";
+        }
+        else {
+          out_fp << stream_labels[l] << ": ";
+        }
+      }
+
+      stream_labels.clear();
+    }
+
+    out_fp << line << "\n";
+  }
+
+  for (unsigned int i = end; i < asm_lines.size(); i++) {
+    stream_labels.push_back(asm_lines[i].substr(0, asm_lines[i].size() - 6));
+  }
+
+  asm_lines.clear();
+  label_jumps.clear();
+  stream_label_base = total_temp_labels;
+}
+
+// Close the program <block> and write what is left with storage
+void end_stream() {
+  close_block(0);
+  finish_program();
+
+  flush_stream();
+
+  out_fp.close();
+  streaming = false;
+}
+
+// Name of the file s_cleanup() removes after an error
+void set_output_filename(std::string filename) {
+  output_filename = filename;
+}
+
+// Write the buffered assembly to the target file
+void write_output_file(std::string filename) {
+  // Set the file pointer up
+  // File has been verified externally prior to call
+  out_fp.open(filename);
+
+  flush_asm();
+
+  out_fp.close();
+}
+
+// Construct a line of code was generated for
+std::string origin_construct(const Node *origin) {
+  if (origin == nullptr) { return "<program>"; }
+
+  for (const Node *child: origin->children) {
+    if (origin->func_label == "<stat>" && child != nullptr) {
+      return child->func_label;
+    }
+  }
+
+  return origin->func_label;
+}
+
+// One line per instruction: index, source line, construct and its label if it has one
+// Line 0 is code outside any statement, like the final STOP
+void print_source_map(std::ostream &map_fp) {
+  if (asm_origins.size() != asm_lines.size()) { return; }
+
+  map_fp << "# instruction line construct [label]\n";
+
+  for (unsigned int i = 0; i < asm_lines.size() && !asm_lines[i].empty(); i++) {
+    const std::string &line = asm_lines[i];
+    const Node *origin = asm_origins[i];
+
+    map_fp << i << " " << (origin == nullptr ? 0 : origin->line) << " " << origin_construct(origin);
+
+    size_t space = line.find(' ');
+    size_t end = (space == std::string::npos) ? line.size() : space;
+
+    if (line[end - 1] == ':') {
+      map_fp << " " << line.substr(0, end - 1);
+    }
+
+    map_fp << "\n";
+  }
+}
+
+// Source map file next to the target
+void write_source_map(std::string filename) {
+  std::ofstream map_fp(filename);
+
+  print_source_map(map_fp);
+
+  map_fp.close();
+}
+
+// Set or clear the top level statement callback
+void set_stat_hook(Stat_Hook hook) {
+  stat_hook = hook;
+}
+
+// Accessors used by incremental recompilation
+std::vector<std::string> &get_asm_lines() {
+  return asm_lines;
+}
+
+std::vector<const Node *> &get_asm_origins() {
+  return asm_origins;
+}
+
+unsigned int get_temp_count() {
+  return total_temp_vars;
+}
+
+unsigned int get_label_count() {
+  return total_temp_labels;
+}
+
+unsigned int get_stack_size() {
+  return total_vars;
+}
+
+unsigned int get_spill_count() {
+  return spill_count;
+}
+
+// Check if a word is a prefix followed only by digits
+bool is_numbered(const std::string &word, const std::string &prefix) {
+  if (word.size() <= prefix.size() || word.compare(0, prefix.size(), prefix) != 0) {
+    return false;
+  }
+
+  for (unsigned int i = prefix.size(); i < word.size(); i++) {
+    if (!isdigit(word[i])) { return false; }
+  }
+
+  return true;
+}
+
+// Renumber generated temps and labels within a line of assembly
+// User labels are L_ followed by an identifier, which never starts with a digit
+std::string rebase_line(const std::string &line, int temp_shift, int label_shift) {
+  std::string result;
+  std::string word;
+
+  for (unsigned int i = 0; i <= line.size(); i++) {
+    if (i < line.size() && line[i] != ' ') {
+      word.push_back(line[i]);
+      continue;
+    }
+
+    // Label declarations carry a trailing colon
+    std::string suffix;
+    if (!word.empty() && word.back() == ':') {
+      suffix = ":";
+      word.pop_back();
+    }
+
+    if (is_numbered(word, VARIABLE_PREFIX)) {
+      word = VARIABLE_PREFIX + std::to_string(std::stoi(word.substr(VARIABLE_PREFIX.size())) + temp_shift);
+    }
+    else if (is_numbered(word, LABEL_PREFIX)) {
+      word = LABEL_PREFIX
+        + std::to_string(std::stoi(word.substr(LABEL_PREFIX.size())) + label_shift);
+    }
+
+    result += word + suffix;
+
+    if (i < line.size()) {
+      result.push_back(' ');
+    }
+
+    word.clear();
+  }
+
+  return result;
+}
+
+// Scope a top level statement of the program <block> starts in
+Scope_Snapshot save_scope() {
+  Scope_Snapshot scope;
+
+  scope.stack.assign(tk_stack, tk_stack + total_vars);
+  scope.base_scope = base_scope;
+  scope.block_level = block_level;
+  scope.globals = global_vars;
+
+  return scope;
+}
+
+// Start this thread's generation over inside a saved scope
+// Numbering starts at 0, errors are held back when deferred
+void load_scope(const Scope_Snapshot &scope, bool defer_errors) {
+  reset_semantics();
+
+  for (unsigned int i = 0; i < scope.stack.size(); i++) {
+    tk_stack[i] = scope.stack[i];
+  }
+
+  total_vars = scope.stack.size();
+  base_scope = scope.base_scope;
+  block_level = scope.block_level;
+  global_vars = scope.globals;
+
+  deferring_errors = defer_errors;
+  error_deferred = false;
+}
+
+// Check if an error was held back since load_scope()
+bool had_deferred_error() {
+  return error_deferred;
+}
+
+// Make sure storage has at least this many spill slots
+void reserve_spills(unsigned int count) {
+  spill_count = std::max(spill_count, count);
+}
+
+// Check if a node is part of an expression
+bool is_expression(Node *node) {
+  std::string label = node->func_label;
+
+  return label == "<expr>" || label == "<N>" || label == "<A>" || label == "<M>" || label == "<R>";
+}
+
+// Find the largest loop invariant expressions in a loop body
+// Anything already hoisted by an enclosing loop is left to it
+// Reused expressions load their temp in place, their earlier copy is not computed yet
+void collect_invariants(Node *node, const std::set<std::string> &writes, std::vector<Node *> &invariants) {
+  if (node == nullptr || hoisted.count(node) != 0 || common_source(node) != nullptr) { return; }
+
+  if (is_expression(node) && is_invariant(node, writes)
+      && has_operator(node) && !has_unsafe_division(node) && !contains_common_source(node)) {
+    invariants.push_back(node);
+    return;
+  }
+
+  for (Node *child: node->children) {
+    collect_invariants(child, writes, invariants);
+  }
+}
+
+// Expression instruction selection
+// Each expression node is labeled with the cheapest rule that gets its value
+// into the accumulator, then reduced with that rule. A direct operand is
+// used by the instruction that needs it without any code of its own:
+// literals (negated ones too) as immediates, globals and temps by name
+//
+//   rule                           code                           cost
+//   acc <- direct                  LOAD x                         1
+//   acc <- local                   STACKR k                       1
+//   acc <- . acc                   <child> MULT -1                child + 1
+//   acc <- op(acc, direct)         <left> OP x                    left + 1
+//   acc <- op(direct, acc)         <right> OP x, + and * only     right + 1
+//   acc <- op(acc, acc)            <right> STORE S <left> OP S    right + left + 2
+//
+// A repeated expression stores its value anyway, so the last rule reuses
+// that temp instead of a spill slot
+// Second operands are computed before first ones, except that + and *
+// go the other way when it needs fewer spill slots (Sethi-Ullman)
+const unsigned int NO_COST = -1;
+
+// Immediate value of an integer literal, negated by any '.' in front of it
+bool immediate_value(Node *node, long long &value) {
+  if (common_source(node) != nullptr || is_common_saved(node) || hoisted.count(node) != 0) {
+    return false;
+  }
+
+  std::string label = node->func_label;
+
+  // . <M>
+  if (label == "<M>") {
+    if (!immediate_value(node->children[0], value)) { return false; }
+
+    value = -value;
+    return true;
+  }
+
+  if (label == "<R>" && node->op == TK_INT) {
+    value = node->value;
+    return true;
+  }
+
+  return false;
+}
+
+// Name or immediate an expression can be used by, empty if it needs code
+// Temps of repeated expressions are only named once their value is stored
+std::string direct_operand(Node *node) {
+  Node *common = common_source(node);
+  if (common != nullptr) {
+    auto temp = common_temps.find(common);
+    return (temp != common_temps.end()) ? temp->second : "";
+  }
 
-// Helper functions to work with stack items
-void push(Token tk) {
-  // Make sure that there is still room in the stack
-  if (total_vars >= MAX_SIZE) {
-    std::cout << "\nSemantic Error: Max number of stack items exceeded. Limit 100. Total Items: "
-      << total_vars << std::endl;
+  auto hoisted_temp = hoisted.find(node);
+  if (hoisted_temp != hoisted.end()) { return hoisted_temp->second; }
 
-    s_cleanup();
+  if (is_common_saved(node) && saving_common != node) { return ""; }
+
+  long long value = 0;
+  if (immediate_value(node, value)) { return std::to_string(value); }
+
+  std::string label = node->func_label;
 
-    exit(EXIT_FAILURE);
+  // Identifier, only globals have storage
+  if (label == "<R>" && node->op == TK_ID && check_vars(node->symbol) == -1 && is_global(node->symbol)) {
+    return node->symbol;
   }
 
-  // Make sure no duplicate vars are declared in the same scope
-  for (unsigned int current_scope = base_scope; current_scope < total_vars; current_scope++) {
+  return "";
+}
 
-    if (tk_stack[current_scope].token_instance == tk.token_instance) {
-      std::cout << "Semantic Error: There was a variable already declared in this scope. Variable: "
-        << tk.token_instance << " on line " << tk.line_num << std::endl;
+// Check if an expression is a direct operand
+// Repeated expressions count once computed, code generation reaches them first
+bool is_direct(Node *node) {
+  return !direct_operand(node).empty() || common_source(node) != nullptr;
+}
 
-      s_cleanup();
+// Check if an expression keeps its value in a temp once computed
+bool saves_value(Node *node) {
+  return is_common_saved(node) && saving_common != node;
+}
 
-      exit(EXIT_FAILURE);
-    }
+// Rule choices for <left> OP <right>
+enum Binary_Rule {
+  RULE_DIRECT_RIGHT,
+  RULE_DIRECT_LEFT,
+  RULE_TEMP,
+  RULE_TEMP_LEFT_FIRST
+};
+
+unsigned int select_cost(Node *);
+unsigned int spill_need(Node *);
+
+// Spill slots the temp rule needs, computing one side and holding it for the other
+unsigned int temp_rule_need(Node *first, Node *second, bool first_saved) {
+  return std::max(spill_need(first), spill_need(second) + (first_saved ? 0 : 1));
+}
+
+// Cheapest rule for a binary operator node, with its cost
+Binary_Rule select_binary(Node *node, unsigned int &cost) {
+  Node *left = node->children[0];
+  Node *right = node->children[1];
+
+  Token_Type tk = node->op;
+  bool commutes = tk == TK_PLUS || tk == TK_STAR;
+
+  unsigned int left_cost = select_cost(left);
+  unsigned int right_cost = select_cost(right);
+
+  Binary_Rule rule = RULE_TEMP;
+  cost = right_cost + left_cost + (saves_value(right) ? 1 : 2);
+
+  if (commutes && is_direct(left) && right_cost + 1 < cost) {
+    rule = RULE_DIRECT_LEFT;
+    cost = right_cost + 1;
   }
 
-  // Push the variable to the global index in stack
-  tk_stack[total_vars] = tk;
+  if (is_direct(right) && left_cost + 1 <= cost) {
+    rule = RULE_DIRECT_RIGHT;
+    cost = left_cost + 1;
+  }
 
-  // Output push instances to file
-  write_asm("PUSH");
+  // Same code either way round, so take the order holding fewer values
+  // A reused expression on the left may refer to its first copy on the right
+  if (rule == RULE_TEMP && commutes && !saves_value(right) && !contains_common_source(left)
+      && temp_rule_need(left, right, false) < temp_rule_need(right, left, false)) {
+    rule = RULE_TEMP_LEFT_FIRST;
+  }
 
-  // Increment count to resemble total variables in stack
-  total_vars++;
+  return rule;
 }
 
-// Remove a token from the stack
-void pop() {
-  // Loop to remove current scope tokens
-  for (unsigned int current_scope = total_vars; current_scope > base_scope; current_scope--) {
+// Instructions needed to get an expression into the accumulator
+unsigned int select_cost(Node *node) {
+  if (is_direct(node)) { return 1; }
 
-    // One less variable is in the stack
-    total_vars--;
+  // Computed as usual, then stored
+  if (saves_value(node)) {
+    Node *outer = saving_common;
+    saving_common = node;
 
-    // Output pop instances to file
-    write_asm("POP");
+    unsigned int cost = select_cost(node) + 1;
 
-    // Reset the value within
-    tk_stack[current_scope].token_instance = "";
-    tk_stack[current_scope].line_num = 0;
+    saving_common = outer;
+    return cost;
+  }
+
+  std::string label = node->func_label;
+
+  if (label == "<R>") { return 1; }
+
+  // . <M>
+  if (label == "<M>") {
+    return select_cost(node->children[0]) + 1;
   }
+
+  unsigned int cost = 0;
+  select_binary(node, cost);
+
+  return cost;
 }
 
-// Find the index of a token
-int find(Token tk) {
-  // Loop to find token
-  for (unsigned int current_scope = total_vars; current_scope > base_scope; current_scope--) {
-    if (tk.token_instance == tk_stack[current_scope].token_instance) {
-      // Calculate the distance from the top of the stack
-      // Offset by one since arrays start at 0
-      return (total_vars - 1) - current_scope;
-    }
+// Spill slots needed at once to get an expression into the accumulator
+unsigned int spill_need(Node *node) {
+  if (is_direct(node)) { return 0; }
+
+  if (saves_value(node)) {
+    Node *outer = saving_common;
+    saving_common = node;
+
+    unsigned int need = spill_need(node);
+
+    saving_common = outer;
+    return need;
   }
 
-  // Negative if no match was found
-  return -1;
+  std::string label = node->func_label;
+
+  if (label == "<R>") { return 0; }
+
+  // . <M>
+  if (label == "<M>") {
+    return spill_need(node->children[0]);
+  }
+
+  Node *left = node->children[0];
+  Node *right = node->children[1];
+
+  unsigned int cost = 0;
+  Binary_Rule rule = select_binary(node, cost);
+
+  if (rule == RULE_DIRECT_RIGHT) { return spill_need(left); }
+  if (rule == RULE_DIRECT_LEFT) { return spill_need(right); }
+  if (rule == RULE_TEMP_LEFT_FIRST) { return temp_rule_need(left, right, false); }
+
+  return temp_rule_need(right, left, saves_value(right));
 }
 
-// Function to help keep track of the current stack at given times
-void print_vars() {
-  for (unsigned int index = 0; index < MAX_SIZE; index++) {
-    if (tk_stack[index].token_instance == "") {
-      std::cout << std::endl;
-      break;
+// Reduce <left> OP <right> with its cheapest rule
+void write_binary(Node *root, const std::string &op, int var_count) {
+  Node *left = root->children[0];
+  Node *right = root->children[1];
+
+  unsigned int cost = 0;
+  Binary_Rule rule = compile_options.select_patterns ? select_binary(root, cost) : RULE_TEMP;
+
+  if (rule == RULE_DIRECT_RIGHT) {
+    process_semantics(left, var_count);
+    write_asm(op, direct_operand(right));
+  }
+  else if (rule == RULE_DIRECT_LEFT) {
+    process_semantics(right, var_count);
+    write_asm(op, direct_operand(left));
+  }
+  else {
+    Node *first = (rule == RULE_TEMP_LEFT_FIRST) ? left : right;
+    Node *second = (rule == RULE_TEMP_LEFT_FIRST) ? right : left;
+
+    bool saved = compile_options.select_patterns && saves_value(first);
+
+    process_semantics(first, var_count);
+
+    // A repeated expression is already in its temp
+    std::string temp_var;
+
+    if (saved) {
+      temp_var = common_temps[first];
+    }
+    else {
+      temp_var = take_spill();
+      write_asm("STORE", temp_var);
     }
 
-    // Print out what is inside of the token
-    std::cout << tk_stack[index].token_instance << " ";
+    process_semantics(second, var_count);
+    write_asm(op, temp_var);
+
+    if (!saved) {
+      release_spill(temp_var);
+    }
   }
 }
 
-// Initialize base variables for assembly output
-void initialize_semantics(Node * root, std::string filename) {
-  output_filename = filename;
-  // Set the file pointer up
-  // File has been verified externally prior to call
-  out_fp.open(filename);
+// Operand the first <expr> of a condition is compared with
+// Computes the second <expr> into a spill slot unless it is a direct operand
+// The slot is released once the branches are written
+std::string select_condition_operand(Node *right, int var_count) {
+  std::string operand = compile_options.select_patterns ? direct_operand(right) : "";
+  if (!operand.empty()) { return operand; }
 
-  // Begin recursive chain
-  process_semantics(root);
+  process_semantics(right, var_count);
+
+  std::string temp_var = take_spill();
+  write_asm("STORE", temp_var);
+
+  return temp_var;
 }
 
 // Handle main recursive check
@@ -253,6 +1624,38 @@ void process_semantics(Node * root, int var_count) {
   // All possible children get checked when recursively calling
   if (root == nullptr) { return; }
 
+  // Value was computed by an earlier statement and kept in a temp
+  Node *common = common_source(root);
+  if (common != nullptr) {
+    write_asm("LOAD", common_temps[common]);
+    return;
+  }
+
+  // Value was computed ahead of the enclosing loop
+  // A repeated expression saved its temp there too
+  auto hoisted_temp = hoisted.find(root);
+  if (hoisted_temp != hoisted.end()) {
+    write_asm("LOAD", hoisted_temp->second);
+    return;
+  }
+
+  // First copy of a repeated expression, keep its value for the others
+  if (is_common_saved(root) && saving_common != root) {
+    Node *outer = saving_common;
+    saving_common = root;
+
+    process_semantics(root, var_count);
+
+    saving_common = outer;
+
+    if (common_temps.count(root) == 0) {
+      common_temps[root] = generate_temp(VARIABLE);
+    }
+
+    write_asm("STORE", common_temps[root]);
+    return;
+  }
+
   std::string label = root->func_label;
 
   /* std::cout << "Next Process Point: " << label << std::endl; */
@@ -263,27 +1666,29 @@ void process_semantics(Node * root, int var_count) {
   if (label == "<program>") {
     unsigned int local_var_count = 0;
 
-    // Evaluate slot for <vars> and <block>
-    iterate_children(root->children, local_var_count);
+    // Globals go straight to storage, no stack traffic at startup
+    declare_globals(root->children[0]);
 
-    // At the end of the traversal, print STOP to target
-    write_asm("STOP");
+    // Evaluate <block>
+    process_semantics(root->children[1], local_var_count);
 
-    // Follow with global variables
-    write_global_vars();
+    finish_program();
   }
   // <vars> -> empty | declare Identifier = Integer ; <vars>
   else if (label == "<vars>") {
+    const Node *outer_origin = current_origin;
+    current_origin = root;
+
     // Identifier
-    int position = find(root->consumed_tokens[1]);
+    int position = find(symbol_token(root));
 
 
     // If not found then it is valid
     // n>=0 (the variable was found on the stack), then issue to the target
     if (position == -1 || position > var_count) {
-      std::string integer_value = root->consumed_tokens[3].token_instance;
+      std::string integer_value = std::to_string(root->value);
 
-      push(root->consumed_tokens[1]);
+      push(symbol_token(root));
 
       // Fetch and add variable to TOS
       write_asm("LOAD", integer_value);
@@ -293,206 +1698,182 @@ void process_semantics(Node * root, int var_count) {
     }
     // If found within the stack of currently stored
     else if (position < var_count) {
-      std::cout << "Semantic Error: Variable declared more than once."
-        << "\n\t Instance: " << root->consumed_tokens[1].token_instance
-        << "\n\t Line: " << root->consumed_tokens[1].line_num
-        << std::endl;
+      std::ostringstream message;
+      message << "Semantic Error: Variable declared more than once."
+        << "\n\t Instance: " << root->symbol
+        << "\n\t Line: " << root->line
+        << "\n";
 
-      s_cleanup();
-
-      exit(EXIT_FAILURE);
+      semantic_error(message.str(), root->line);
     }
 
     // iterate over remaining children, if any
-    iterate_children(root->children, var_count);
+    iterate_children(root, var_count);
+
+    current_origin = outer_origin;
   }
   // <block> -> start <vars> <stats> stop
   else if (label == "<block>") {
     unsigned int local_var_count = 0;
 
-    // Store scope for current block
-    // Used to remove from stack once scope ends
-    base_scope = total_vars;
+    unsigned int outer_scope = open_block();
 
     // <vars> and <stats>
-    iterate_children(root->children, local_var_count);
+    iterate_children(root, local_var_count);
 
-    // Remove a scope level once finished with block
-    pop();
+    close_block(outer_scope);
   }
-  // <expr> -> <N> + <expr> | <N>
-  else if (label == "<expr>") {
-    // <N>
-    if (root->consumed_tokens.empty()) {
-      iterate_children(root->children, var_count);
+  // <stat>, the code it writes is mapped back to its line
+  // Directly inside the program <block> it is handed to the hook when one is set
+  else if (label == "<stat>") {
+    const Node *outer_origin = current_origin;
+    current_origin = root;
+
+    if (stat_hook != nullptr && block_level == 1) {
+      stat_hook(root, var_count);
     }
-    // <N> + <expr>
     else {
-      // <expr>
-      process_semantics(root->children[1], var_count);
-
-      // Get a temp var for storage
-      std::string temp_var = generate_temp(VARIABLE);
-      write_asm("STORE", temp_var);
-
-      // <N>
-      process_semantics(root->children[0], var_count);
-      write_asm("ADD", temp_var);
+      iterate_children(root, var_count);
     }
+
+    current_origin = outer_origin;
+  }
+  // <N> + <expr>
+  else if (label == "<expr>") {
+    write_binary(root, "ADD", var_count);
   }
-  // <N> -> <A> / <N> | <A> * <N> | <A>
+  // <A> / <N> | <A> * <N>
   else if (label == "<N>") {
-    // <A>
-    if (root->consumed_tokens.empty()) {
-      iterate_children(root->children, var_count);
-    }
-    // <A> ? <N>
-    else {
-      process_semantics(root->children[1], var_count);
-
-      // Get a temp var for storage
-      std::string temp_var = generate_temp(VARIABLE);
-      write_asm("STORE", temp_var);
+    // Branch for symbols
+    Token_Type temp_tk = root->op;
 
-      process_semantics(root->children[0], var_count);
-
-      // Branch for symbols
-      Token_Type temp_tk = root->consumed_tokens[0].token_ID;
-
-      // /
-      if (temp_tk == TK_SLASH) {
-        write_asm("DIV", temp_var);
-      }
-      // *
-      else if (temp_tk == TK_STAR) {
-        write_asm("MULT", temp_var);
-      }
+    // /
+    if (temp_tk == TK_SLASH) {
+      write_binary(root, "DIV", var_count);
+    }
+    // *
+    else if (temp_tk == TK_STAR) {
+      write_binary(root, "MULT", var_count);
     }
   }
-  // <A> -> <M> - <A> | <M>
+  // <M> - <A>
   else if (label == "<A>") {
-    // <M>
-    if (root->consumed_tokens.empty()) {
-      iterate_children(root->children, var_count);
-    }
-    // <M> - <A>
-    else {
-      process_semantics(root->children[1], var_count);
-
-      // Get a temp var for storage
-      std::string temp_var = generate_temp(VARIABLE);
-      write_asm("STORE", temp_var);
-
-      process_semantics(root->children[0], var_count);
-      write_asm("SUB", temp_var);
-    }
+    write_binary(root, "SUB", var_count);
   }
-  // <M> -> . <M> | <R>
+  // . <M>
   else if (label == "<M>") {
-    // <R>
-    if (root->consumed_tokens.empty()) {
-      iterate_children(root->children, var_count);
+    long long value = 0;
+
+    // Negated literals load as an immediate
+    if (compile_options.select_patterns && immediate_value(root, value)) {
+      write_asm("LOAD", std::to_string(value));
+      return;
     }
-    // . <M>
-    else {
-      iterate_children(root->children, var_count);
 
-      Token_Type temp_tk = root->consumed_tokens[0].token_ID;
+    iterate_children(root, var_count);
 
-      // . to negate
-      if (temp_tk == TK_PERIOD) {
-        write_asm("MULT", "-1");
-      }
-    }
+    // . to negate
+    write_asm("MULT", "-1");
   }
-  // <R> -> ( <expr> ) | Identifier | Integer
+  // Identifier | Integer
   else if (label == "<R>") {
-    // ( <expr> )
-    if (!root->children.empty()) {
-      iterate_children(root->children, var_count);
-    }
-    // Only check if not empty
-    // Identifier | Integer
-    else {
-      Token temp_tk = root->consumed_tokens[0];
-      Token_Type temp_tk_id = temp_tk.token_ID;
-
-      // Identifier
-      if (temp_tk_id == TK_ID) {
-        int position = check_vars(temp_tk.token_instance);
-
-        // If not found
-        if (position == -1) {
-          std::cout << "Semantic Error: Usage of undeclared variable."
-            << "\n\t Instance: " << temp_tk.token_instance
-            << "\n\t Line: " << temp_tk.line_num
-            << std::endl;
-
-          s_cleanup();
-
-          exit(EXIT_FAILURE);
-        }
+    Token temp_tk = symbol_token(root);
+    Token_Type temp_tk_id = root->op;
 
-        // Otherwise read the value at position
-        write_asm("STACKR", std::to_string(position));
+    // Identifier
+    if (temp_tk_id == TK_ID) {
+      int position = check_vars(temp_tk.token_instance);
+
+      // If not found
+      if (position == -1 && !is_global(temp_tk.token_instance)) {
+        std::ostringstream message;
+        message << "Semantic Error: Usage of undeclared variable."
+          << "\n\t Instance: " << temp_tk.token_instance
+          << "\n\t Line: " << temp_tk.line_num
+          << "\n";
+
+        semantic_error(message.str(), temp_tk.line_num);
       }
-      // Integer
-      else if (temp_tk_id == TK_INT) {
+
+      // Globals are read from storage
+      if (position == -1) {
         write_asm("LOAD", temp_tk.token_instance);
       }
+      // Otherwise read the value at position
+      else {
+        write_asm("STACKR", std::to_string(position));
+      }
+    }
+    // Integer
+    else if (temp_tk_id == TK_INT) {
+      write_asm("LOAD", std::to_string(root->value));
     }
   }
   // <in> -> listen Identifier
   else if (label == "<in>") {
-    Token temp_tk = root->consumed_tokens[1];
+    Token temp_tk = symbol_token(root);
 
     // Identifier
     int position = check_vars(temp_tk.token_instance);
 
     // If no instance cannot be found
-    if (position == -1) {
-      std::cout << "Semantic Error: Usage of undeclared variable."
+    if (position == -1 && !is_global(temp_tk.token_instance)) {
+      std::ostringstream message;
+      message << "Semantic Error: Usage of undeclared variable."
         << "\n\t Instance: " << temp_tk.token_instance
         << "\n\t Line: " << temp_tk.line_num
-        << std::endl;
+        << "\n";
 
-      s_cleanup();
+      semantic_error(message.str(), temp_tk.line_num);
+    }
 
-      exit(EXIT_FAILURE);
+    // Globals are read straight into storage
+    if (position == -1) {
+      write_asm("READ", temp_tk.token_instance);
+      return;
     }
 
-    // Get a temp var for storage
-    std::string temp_var = generate_temp(VARIABLE);
+    // Get a slot for storage
+    std::string temp_var = take_spill();
 
     // listen reads input and stores in identifier
     write_asm("READ", temp_var);
     write_asm("LOAD", temp_var);
     write_asm("STACKW", std::to_string(position));
+
+    release_spill(temp_var);
   }
   // <out> -> talk <expr>
   else if (label == "<out>") {
-    iterate_children(root->children, var_count);
+    // Globals and temps are written from where they are
+    std::string operand = compile_options.select_patterns ? direct_operand(root->children[0]) : "";
+    long long value = 0;
+
+    if (!operand.empty() && !immediate_value(root->children[0], value)) {
+      write_asm("WRITE", operand);
+      return;
+    }
 
-    // Get a temp var for storage
-    std::string temp_var = generate_temp(VARIABLE);
+    iterate_children(root, var_count);
+
+    // Get a slot for storage
+    std::string temp_var = take_spill();
 
     // talk outputs the given calculated expression
     write_asm("STORE", temp_var);
     write_asm("WRITE", temp_var);
+
+    release_spill(temp_var);
   }
   // <if> -> if [ <expr> <RO> <expr> ] then <stat>
   //          | if [ <expr> <RO> <expr> ] then <stat> else <stat>
   else if (label == "<if>") {
     // [   0       1     2       3           4         ]
     // [ <expr>, <RO>, <expr>, <stat>, optional <stat> ]
-    Token temp_tk = root->children[1]->consumed_tokens[0];
-    Token_Type temp_tk_id = temp_tk.token_ID;
-
-    std::string temp_var = generate_temp(VARIABLE);
+    Token_Type temp_tk_id = root->children[1]->op;
 
     // Get value of second <expr>
-    process_semantics(root->children[2], var_count);
-    write_asm("STORE", temp_var);
+    std::string temp_var = select_condition_operand(root->children[2], var_count);
 
     // Get value of first <expr>
     process_semantics(root->children[0], var_count);
@@ -513,12 +1894,31 @@ void process_semantics(Node * root, int var_count) {
 
     std::string temp_end_if_label = generate_temp(LABEL);
 
+    // == only exits with two branches, but holds with a single BRZERO
+    // So branch to the then <stat> instead and let the else <stat> fall through
+    // Labels are declared in order, so arms that hold one keep their place
+    bool swap_arms = has_else && temp_tk_id == TK_EQUALS_EQUALS
+      && !contains_node(root->children[3], "<label>") && !contains_node(root->children[4], "<label>");
+
     // Evaluate <RO> branches and adjust labels
-    if (has_else) {
+    if (swap_arms) {
+      std::string temp_then_label = generate_temp(LABEL);
+
+      write_inverse_RO(temp_tk_id, temp_var, temp_then_label);
+      release_spill(temp_var);
+
+      process_semantics(root->children[4], var_count);
+      write_asm("BR", temp_end_if_label);
+
+      write_asm(temp_then_label + ":", "NOOP");
+      process_semantics(root->children[3], var_count);
+    }
+    else if (has_else) {
       std::string temp_else_label = generate_temp(LABEL);
 
       // Normal if then, but now else will be exit point
       write_RO(temp_tk_id, temp_var, temp_else_label);
+      release_spill(temp_var);
 
       // statements inside if section
       // Should also jump to end if label when if expression is true
@@ -533,6 +1933,7 @@ void process_semantics(Node * root, int var_count) {
     // Normal if then
     else {
       write_RO(temp_tk_id, temp_var, temp_end_if_label);
+      release_spill(temp_var);
       process_semantics(root->children[3], var_count);
     }
 
@@ -543,56 +1944,167 @@ void process_semantics(Node * root, int var_count) {
   // <loop> -> while [ <expr> <RO> <expr> ] <stat>
   else if (label == "<loop>") {
     // [<expr>, <RO>, <expr>, <stat>]
-    Token temp_tk = root->children[1]->consumed_tokens[0];
-    Token_Type temp_tk_id = temp_tk.token_ID;
+    Token_Type temp_tk_id = root->children[1]->op;
 
-    // Get a temp var for storage
-    std::string temp_var = generate_temp(VARIABLE);
+    Node *body = root->children[3];
 
-    // Get temp labels
-    std::string temp_start_label = generate_temp(LABEL);
-    std::string temp_end_label = generate_temp(LABEL);
+    // Loops with a known trip count are unrolled within the size budget
+    // Fully unrolled loops are just copies of the body, no checks or branches
+    unsigned int trips = 0;
+    unsigned int copies = 1;
+    bool counted = loop_trip_count(root, trips) && trips > 0;
+    bool unrolled = false;
 
-    // Declare start of loop label
-    write_asm(temp_start_label + ":", "NOOP");
+    if (counted && compile_options.unroll_budget > 0) {
+      unsigned long long size = std::max(estimate_size(body), 1u);
 
-    // Evaluate second <expr> and store value
-    process_semantics(root->children[2], var_count);
-    write_asm("STORE", temp_var);
+      // Otherwise as many copies per check as fit
+      unrolled = trips * size <= compile_options.unroll_budget;
+      copies = std::max((unsigned int) (compile_options.unroll_budget / size), 1u);
+    }
 
-    // Evaluate other <expr>
-    process_semantics(root->children[0], var_count);
+    // Second <expr> compared as it is, without a temp
+    std::string direct_right = (!unrolled && compile_options.select_patterns) ? direct_operand(root->children[2]) : "";
+
+    // Only a loop that still checks needs labels
+    std::string temp_var = direct_right;
+    std::string temp_start_label;
+    std::string temp_end_label;
+
+    if (!unrolled) {
+      temp_start_label = generate_temp(LABEL);
+      temp_end_label = generate_temp(LABEL);
+    }
+
+    // Anything the body never writes can be computed once before the loop
+    // Labels in the body could be jumped into, so leave those loops alone
+    bool can_hoist = !contains_node(body, "<label>");
+
+    std::set<std::string> writes;
+    loop_writes(body, writes);
+
+    std::vector<Node *> loop_hoisted;
+
+    // Invariant second <expr> stays in its temp for every check
+    bool hoist_right = !unrolled && direct_right.empty() && can_hoist && is_invariant(root->children[2], writes);
+
+    if (hoist_right) {
+      process_semantics(root->children[2], var_count);
+
+      temp_var = generate_temp(VARIABLE);
+      write_asm("STORE", temp_var);
+    }
+
+    // Invariant first <expr> is only worth a temp if it is more than a load
+    if (!unrolled && can_hoist && is_invariant(root->children[0], writes) && has_operator(root->children[0])) {
+      loop_hoisted.push_back(root->children[0]);
+    }
 
-    // Evaluate <RO>
-    write_RO(temp_tk_id, temp_var, temp_end_label);
+    // Copies of an unrolled body share hoisted values too
+    if (can_hoist && (!unrolled || trips > 1)) {
+      collect_invariants(body, writes, loop_hoisted);
+    }
+
+    for (Node *node: loop_hoisted) {
+      process_semantics(node, var_count);
+
+      std::string hoisted_var = generate_temp(VARIABLE);
+      write_asm("STORE", hoisted_var);
+
+      hoisted[node] = hoisted_var;
+    }
+
+    // Straight line copies, one per pass
+    if (unrolled) {
+      for (unsigned int i = 0; i < trips; i++) {
+        process_semantics(body, var_count);
+      }
+
+      for (Node *node: loop_hoisted) {
+        hoisted.erase(node);
+      }
+
+      return;
+    }
+
+    // Passes left over from the copies run first, so the rest divides evenly
+    for (unsigned int i = 0; i < trips % copies; i++) {
+      process_semantics(body, var_count);
+    }
+
+    // Loops are bottom tested, guarded by one check on entry
+    //    <condition>, exit to L_END when false
+    // L_START
+    //    <stat>
+    //    <condition>, back to L_START when true
+    // L_END
+    // Saves the BR and label NOOP each iteration would otherwise run
+    // Counted loops are known to run, so they skip the guard
+    for (int check = counted ? 1 : 0; check < 2; check++) {
+      if (check == 1) {
+        // Declare start of loop label
+        write_asm(temp_start_label + ":", "NOOP");
+
+        // Iterate <stat>, once per copy
+        for (unsigned int i = 0; i < copies; i++) {
+          process_semantics(body, var_count);
+        }
+      }
 
-    // Iterate <stat>
-    process_semantics(root->children[3], var_count);
+      // Evaluate second <expr> and store value
+      std::string check_var = temp_var;
+
+      if (!hoist_right && direct_right.empty()) {
+        process_semantics(root->children[2], var_count);
+
+        check_var = take_spill();
+        write_asm("STORE", check_var);
+      }
+
+      // Evaluate other <expr>
+      process_semantics(root->children[0], var_count);
+
+      // Evaluate <RO>
+      if (check == 0) {
+        write_RO(temp_tk_id, check_var, temp_end_label);
+      }
+      else {
+        write_inverse_RO(temp_tk_id, check_var, temp_start_label);
+      }
+
+      release_spill(check_var);
+    }
 
     // Declare end of loop
-    write_asm("BR", temp_start_label);
     write_asm(temp_end_label + ":", "NOOP");
+
+    for (Node *node: loop_hoisted) {
+      hoisted.erase(node);
+    }
   }
   // <assign> -> assign Identifier = <expr>
   else if (label == "<assign>") {
-    Token temp_tk = root->consumed_tokens[1];
+    Token temp_tk = symbol_token(root);
 
     // <expr>
-    iterate_children(root->children, var_count);
+    iterate_children(root, var_count);
 
     // Identifier
     int position = check_vars(temp_tk.token_instance);
 
     // If no instance cannot be found
-    if (position == -1) {
-      std::cout << "Semantic Error: Usage of undeclared variable."
+    if (position == -1 && !is_global(temp_tk.token_instance)) {
+      std::ostringstream message;
+      message << "Semantic Error: Usage of undeclared variable."
         << "\n\t Instance: " << temp_tk.token_instance
         << "\n\t Line: " << temp_tk.line_num
-        << std::endl;
-
-      s_cleanup();
+        << "\n";
 
-      exit(EXIT_FAILURE);
+      semantic_error(message.str(), temp_tk.line_num);
+    }
+    // Globals are written to storage
+    else if (position == -1) {
+      write_asm("STORE", temp_tk.token_instance);
     }
     // If found then write value
     else {
@@ -601,64 +2113,69 @@ void process_semantics(Node * root, int var_count) {
   }
   // <label> -> label Identifier
   else if (label == "<label>") {
-    Token temp_tk = root->consumed_tokens[1];
-    std::string t_label = root->consumed_tokens[1].token_instance;
+    std::string t_label = root->symbol;
 
-    // Identifier
-    int position = find(temp_tk);
+    // Same names in sibling blocks get their own assembly label
+    std::string asm_label = LABEL_PREFIX + t_label;
 
-    // If not found then it is valid
-    if (position == -1 || position > var_count) {
-      temp_tk.token_instance = LABEL_PREFIX + t_label;
-      push(temp_tk);
+    if (block_level > 1) {
+      asm_label += "_" + std::to_string(nested_labels++);
+    }
 
-      // No children left over at this point
-      // Initialize labels to NOOP
-      write_asm(LABEL_PREFIX + t_label + ":", "NOOP");
+    std::vector<unsigned int> resolved;
 
-      var_count++;
-    }
-    // If found within the stack of currently stored
-    else if (position < var_count) {
-      std::cout << "Semantic Error: Identifier declared more than once."
+    if (!user_labels.define(t_label, label_names.size(), resolved)) {
+      std::ostringstream message;
+      message << "Semantic Error: Identifier declared more than once."
         << "\n\t Instance: " << t_label
-        << "\n\t Line: " << temp_tk.line_num
-        << std::endl;
+        << "\n\t Line: " << root->line
+        << "\n";
 
-      s_cleanup();
+      semantic_error(message.str(), root->line);
+    }
+
+    label_names.push_back(asm_label);
+    label_depths.push_back(total_vars);
 
-      exit(EXIT_FAILURE);
+    // Backpatch the jumps that were waiting on this label
+    for (unsigned int site: resolved) {
+      asm_lines[label_jumps[site].first] = "BR " + asm_label;
     }
+
+    // Labels take no stack slot, only a NOOP to attach to
+    write_asm(asm_label + ":", "NOOP");
   }
   // <goto> -> jump Identifier
   else if (label == "<goto>") {
-    // Only process if the goto is already defined
-    Token temp_tk = root->consumed_tokens[1];
-
-    // Identifier
-    int position = check_vars(LABEL_PREFIX + temp_tk.token_instance);
-
-    // If no instance cannot be found
-    if (position == -1) {
-      std::cout << "Semantic Error: Usage of undeclared label identifier."
-        << "\n\t Instance: " << temp_tk.token_instance
-        << "\n\t Line: " << temp_tk.line_num
-        << std::endl;
-
-      s_cleanup();
-
-      exit(EXIT_FAILURE);
-    }
-    // Otherwise allow the jump to occur
-    else {
-      write_asm("BR", LABEL_PREFIX + temp_tk.token_instance);
-    }
+    write_jump(root->symbol, symbol_token(root));
   }
   // Most things should be able to just keep recursively iterating their children
   // Not containing vars specifically
   else {
-    iterate_children(root->children, var_count);
+    iterate_children(root, var_count);
+  }
+}
+
+// Report a semantic error, unless this thread holds them back, then end the compile
+void semantic_error(const std::string &message, unsigned int line) {
+  if (!deferring_errors) {
+    report_diagnostic(SEMANTIC_ERROR, line, message);
+  }
+
+  semantic_exit();
+}
+
+// Semantic errors end the compile
+// A thread deferring them carries on instead, its code is thrown away
+void semantic_exit() {
+  if (deferring_errors) {
+    error_deferred = true;
+    return;
   }
+
+  s_cleanup();
+
+  abort_compile();
 }
 
 // Remove temp file
@@ -1,13 +1,25 @@
 #ifndef RUNTIME_SEMANTICS_H
 #define RUNTIME_SEMANTICS_H
 
+#include <ostream>
+#include <string>
+#include <utility>
 #include <vector>
 
 #include "node.h"
 
+enum temp_type {
+  LABEL,
+  VARIABLE
+};
+
+// Callback for top level statements, receives the <stat> and var count
+typedef void (*Stat_Hook)(Node *, int);
+
 void process_semantics(Node *, int=0);
 
-void iterate_children(std::vector<Node *>, unsigned int);
+void iterate_children(Node *, unsigned int);
+Token symbol_token(Node *);
 
 // Suggested interfaces
 // Swapped with tokens to preserve data
@@ -18,13 +30,61 @@ int find(Token);
 void print_vars();
 int check_vars(std::string);
 
-void write_asm(std::string, std::string);
+void write_asm(std::string, std::string="");
+void write_jump(const std::string &, Token);
 void write_global_vars();
-void write_RO(Token, std::string, std::string);
+unsigned int open_block();
+void close_block(unsigned int);
+void finish_program();
+void flush_asm();
+void write_difference(std::string);
+void write_RO(Token_Type, std::string, std::string);
+void write_inverse_RO(Token_Type, std::string, std::string);
+void clean_control_flow(bool=false);
+void track_accumulator();
+void reset_semantics();
 void initialize_semantics(Node *, std::string="");
+void set_output_filename(std::string);
+void write_output_file(std::string);
+void print_source_map(std::ostream &);
+void write_source_map(std::string);
+
+// Streaming compilation, one top level statement at a time
+void discard_stream();
+void begin_stream(Node *, std::string);
+void stream_statement(Node *);
+void flush_stream();
+void end_stream();
+
+// Incremental recompilation support
+void set_stat_hook(Stat_Hook);
+std::vector<std::string> &get_asm_lines();
+std::vector<const Node *> &get_asm_origins();
+unsigned int get_temp_count();
+unsigned int get_label_count();
+unsigned int get_stack_size();
+unsigned int get_spill_count();
+void reserve_spills(unsigned int);
+std::string rebase_line(const std::string &, int, int);
+
+// Generating top level statements on other threads
+struct Scope_Snapshot {
+  std::vector<Token> stack;
+  unsigned int base_scope;
+  unsigned int block_level;
+  std::vector<std::pair<std::string, std::string>> globals;
+};
+
+Scope_Snapshot save_scope();
+void load_scope(const Scope_Snapshot &, bool);
+bool had_deferred_error();
 
 std::string generate_temp(int);
+std::string take_spill();
+void release_spill(const std::string &);
 
+void semantic_error(const std::string &, unsigned int);
+void semantic_exit();
 void s_cleanup();
 
 #endif
@@ -0,0 +1,253 @@
+#include <condition_variable>
+#include <cstdlib>
+#include <iostream>
+#include <memory>
+#include <mutex>
+#include <new>
+#include <sstream>
+#include <thread>
+#include <utility>
+
+#include "diagnostics.h"
+#include "scan_pipeline.h"
+#include "scanner.h"
+
+const size_t TOKEN_RING_MASK = TOKEN_RING_SIZE - 1;
+
+// Tries on the ring before a side sleeps, enough to cover a short wait on the other
+// without spinning away a core the other side may need
+const unsigned int SPIN_LIMIT = 128;
+
+// A sleeping side is woken once this many tokens or free slots are waiting for it,
+// so it runs for a while instead of being switched in for every token
+const size_t WAKE_BATCH = TOKEN_RING_SIZE / 2;
+
+void Token_Ring::clear() {
+  head.store(0, std::memory_order_relaxed);
+  tail.store(0, std::memory_order_relaxed);
+  cached_tail = 0;
+  cached_head = 0;
+}
+
+bool Token_Ring::try_push(Scanned_Token &scanned) {
+  size_t position = tail.load(std::memory_order_relaxed);
+
+  // Only look at the consumer's position again when the cached one says full
+  if (position - cached_head == TOKEN_RING_SIZE) {
+    cached_head = head.load(std::memory_order_acquire);
+
+    if (position - cached_head == TOKEN_RING_SIZE) {
+      return false;
+    }
+  }
+
+  slots[position & TOKEN_RING_MASK] = std::move(scanned);
+  tail.store(position + 1, std::memory_order_release);
+
+  return true;
+}
+
+bool Token_Ring::try_pop(Scanned_Token &scanned) {
+  size_t position = head.load(std::memory_order_relaxed);
+
+  if (position == cached_tail) {
+    cached_tail = tail.load(std::memory_order_acquire);
+
+    if (position == cached_tail) {
+      return false;
+    }
+  }
+
+  scanned = std::move(slots[position & TOKEN_RING_MASK]);
+  head.store(position + 1, std::memory_order_release);
+
+  return true;
+}
+
+// Ring and scanner thread of the parser on one thread
+// Going away stops the scanner, which exit() does before the scanner tables are freed
+struct Scan_Pipeline {
+  Token_Ring ring;
+  std::thread thread;
+  std::atomic<bool> stop_scanning;
+
+  // A side out of spins sleeps here until the other moves its position
+  std::mutex mutex;
+  std::condition_variable wake;
+  std::atomic<bool> parser_waiting;
+  std::atomic<bool> scanner_waiting;
+
+  Scan_Pipeline() : stop_scanning(false), parser_waiting(false), scanner_waiting(false) {}
+
+  ~Scan_Pipeline() {
+    stop_scan_thread();
+  }
+
+  // Plain new only aligns to 16 bytes before C++17, the ring positions need their own cache lines
+  static void *operator new(size_t size) {
+    void *memory = nullptr;
+
+    if (posix_memalign(&memory, alignof(Scan_Pipeline), size) != 0) {
+      throw std::bad_alloc();
+    }
+
+    return memory;
+  }
+
+  static void operator delete(void *memory) {
+    free(memory);
+  }
+};
+
+// Made the first time this thread starts a scanner thread, then reused
+static thread_local std::unique_ptr<Scan_Pipeline> pipeline;
+
+// Consumer side, true from start until the thread is joined
+static thread_local bool scanning = false;
+
+// Tokens in the ring, either side may ask
+size_t ring_fill(const Token_Ring &ring) {
+  return ring.tail.load(std::memory_order_relaxed) - ring.head.load(std::memory_order_relaxed);
+}
+
+// Wake the other side if it is asleep, after this side moved its position
+// The fence pairs with the one in wait_on(), so either the sleeper sees the new
+// position or this side sees it waiting, and only the first waker notifies
+void wake_if_waiting(Scan_Pipeline *pipe, std::atomic<bool> &waiting) {
+  std::atomic_thread_fence(std::memory_order_seq_cst);
+
+  if (waiting.load(std::memory_order_relaxed) && waiting.exchange(false)) {
+    std::lock_guard<std::mutex> lock(pipe->mutex);
+    pipe->wake.notify_all();
+  }
+}
+
+// Sleep until ready() holds, flagging this side as waiting before each check
+template <typename Ready>
+void wait_on(Scan_Pipeline *pipe, std::atomic<bool> &waiting, Ready ready) {
+  std::unique_lock<std::mutex> lock(pipe->mutex);
+
+  while (true) {
+    waiting.store(true, std::memory_order_relaxed);
+    std::atomic_thread_fence(std::memory_order_seq_cst);
+
+    if (ready()) { break; }
+
+    pipe->wake.wait(lock);
+  }
+
+  waiting.store(false, std::memory_order_relaxed);
+}
+
+// Scan until EOF, giving up if the parser stops first
+void scan_tokens(Scan_Pipeline *pipe, std::istream *in_fp, unsigned int line_num) {
+  std::ostringstream err_fp;
+  Scanned_Token scanned;
+
+  while (!pipe->stop_scanning.load(std::memory_order_relaxed)) {
+    scanned.token = scanner(*in_fp, line_num, err_fp);
+    scanned.message = err_fp.str();
+
+    if (!scanned.message.empty()) {
+      err_fp.str("");
+    }
+
+    bool last = (scanned.token.token_ID == TK_EOF);
+
+    unsigned int spins = 0;
+    bool pushed;
+
+    while (!(pushed = pipe->ring.try_push(scanned)) && ++spins < SPIN_LIMIT) {
+      if (pipe->stop_scanning.load(std::memory_order_relaxed)) {
+        return;
+      }
+    }
+
+    if (!pushed) {
+      wait_on(pipe, pipe->scanner_waiting, [&]() {
+        return pipe->stop_scanning.load(std::memory_order_relaxed) || pipe->ring.try_push(scanned);
+      });
+
+      if (pipe->stop_scanning.load(std::memory_order_relaxed)) {
+        return;
+      }
+    }
+
+    // The first token goes straight to the parser, which is waiting to start on it
+    bool first = (pipe->ring.tail.load(std::memory_order_relaxed) == 1);
+
+    if (first || last || ring_fill(pipe->ring) >= WAKE_BATCH) {
+      wake_if_waiting(pipe, pipe->parser_waiting);
+    }
+
+    if (last) {
+      return;
+    }
+  }
+}
+
+void start_scan_thread(std::istream &in_fp, unsigned int line_num) {
+  stop_scan_thread();
+
+  if (pipeline == nullptr) {
+    pipeline.reset(new Scan_Pipeline());
+  }
+
+  pipeline->ring.clear();
+  pipeline->stop_scanning.store(false);
+  scanning = true;
+
+  pipeline->thread = std::thread(scan_tokens, pipeline.get(), &in_fp, line_num);
+}
+
+bool scan_thread_running() {
+  return scanning;
+}
+
+// Next token in scan order, waiting on the thread if it is behind
+// After EOF the thread is joined, and the stream is the caller's again
+Token take_scanned_token() {
+  Scan_Pipeline *pipe = pipeline.get();
+  Scanned_Token scanned;
+
+  unsigned int spins = 0;
+  bool popped;
+
+  while (!(popped = pipe->ring.try_pop(scanned)) && ++spins < SPIN_LIMIT) {}
+
+  if (!popped) {
+    wait_on(pipe, pipe->parser_waiting, [&]() {
+      return pipe->ring.try_pop(scanned);
+    });
+  }
+
+  if (ring_fill(pipe->ring) <= TOKEN_RING_SIZE - WAKE_BATCH) {
+    wake_if_waiting(pipe, pipe->scanner_waiting);
+  }
+
+  if (!scanned.message.empty()) {
+    report_diagnostic(SCANNER_ERROR, scanned.token.line_num, scanned.message);
+  }
+
+  if (scanned.token.token_ID == TK_EOF) {
+    pipeline->thread.join();
+    scanning = false;
+  }
+
+  return scanned.token;
+}
+
+void stop_scan_thread() {
+  if (!scanning) { return; }
+
+  pipeline->stop_scanning.store(true);
+
+  // The scanner may be asleep on a full ring
+  {
+    std::lock_guard<std::mutex> lock(pipeline->mutex);
+    pipeline->wake.notify_all();
+  }
+
+  pipeline->thread.join();
+  scanning = false;
+}
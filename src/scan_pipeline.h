@@ -0,0 +1,58 @@
+#ifndef SCAN_PIPELINE_H
+#define SCAN_PIPELINE_H
+
+#include <atomic>
+#include <cstddef>
+#include <istream>
+#include <string>
+
+#include "token.h"
+
+// Slots in the ring, a power of two so positions wrap with a mask
+const size_t TOKEN_RING_SIZE = 1024;
+
+// A token along with any error the scanner printed while finding it
+struct Scanned_Token {
+  Token token;
+  std::string message;
+};
+
+// Bounded ring between one producer and one consumer, no locks
+// Each side only stores its own position and reads the other's to see how far
+// it may go, the release/acquire pair makes the slot visible before the position
+struct Token_Ring {
+  Scanned_Token slots[TOKEN_RING_SIZE];
+
+  // Next slot to pop, written by the consumer
+  alignas(64) std::atomic<size_t> head;
+  size_t cached_tail;
+
+  // Next slot to push, written by the producer
+  alignas(64) std::atomic<size_t> tail;
+  size_t cached_head;
+
+  Token_Ring() : head(0), tail(0) {
+    this->cached_tail = 0;
+    this->cached_head = 0;
+  }
+
+  void clear();
+
+  // False when full, the token is left as it was
+  bool try_push(Scanned_Token &);
+
+  // False when empty
+  bool try_pop(Scanned_Token &);
+};
+
+// Scanner thread filling the ring while the parser on this thread takes tokens from it
+// A side left with nothing to do spins briefly, then sleeps until woken
+// Errors are reported as their token is taken, so they stay in order
+void start_scan_thread(std::istream &, unsigned int);
+bool scan_thread_running();
+Token take_scanned_token();
+
+// Stops and joins the thread, also done at exit if the parser gives up early
+void stop_scan_thread();
+
+#endif
@@ -1,6 +1,8 @@
 #include <iostream>
+#include <sstream>
 #include <map>
 
+#include "diagnostics.h"
 #include "scanner.h"
 
 // start stop loop while for label exit listen talk program if then assign declare jump else =====> 16
@@ -200,13 +202,13 @@ int find_col(char c) {
   }
   // A match was found
   else {
-    return symbol_columns[c];
+    return search->second;
   }
 }
 
 // Remove anything between && symbols
 // At the moment will just eat everything until end of line or file
-bool remove_comments(std::ifstream &in_fp, unsigned int &line_num, char &current_char) {
+bool remove_comments(std::istream &in_fp, unsigned int &line_num, char &current_char, std::ostream &err_fp) {
   /* std::cout << "Comment Detected" << std::endl; */
 
   // Verify pair of &&
@@ -229,7 +231,7 @@ bool remove_comments(std::ifstream &in_fp, unsigned int &line_num, char &current
       in_fp.get(current_char);
     }
 
-    std::cout << "\nSCANNER ERROR: L" << line_num
+    err_fp << "\nSCANNER ERROR: L" << line_num
       << ": Invalid comment. Missing starting pair of '&'" << std::endl;
 
 
@@ -264,7 +266,7 @@ bool remove_comments(std::ifstream &in_fp, unsigned int &line_num, char &current
 
     // If there is no match found by EOF, it failed
     if (in_fp.eof()) {
-      std::cout << "\nSCANNER ERROR: L" << line_num
+      err_fp << "\nSCANNER ERROR: L" << line_num
         << ": Invalid comment. EOF reached. Missing ending pair of '&'" << std::endl;
 
       return false;
@@ -272,7 +274,7 @@ bool remove_comments(std::ifstream &in_fp, unsigned int &line_num, char &current
 
     // If it hits a line ending then it likely failed
     if (next_char == '\n') {
-      std::cout << "\nSCANNER ERROR: L" << line_num
+      err_fp << "\nSCANNER ERROR: L" << line_num
         << ": Invalid comment. New line hit. Missing ending pair of '&'" << std::endl;
 
       return false;
@@ -294,7 +296,22 @@ bool remove_comments(std::ifstream &in_fp, unsigned int &line_num, char &current
 }
 
 // Tester will ask scanner for one token at a time
-Token scanner(std::ifstream &in_fp, unsigned int &line_num) {
+// Errors are reported once their token is scanned
+Token scanner(std::istream &in_fp, unsigned int &line_num) {
+  static thread_local std::ostringstream err_fp;
+
+  Token tk = scanner(in_fp, line_num, err_fp);
+
+  if (err_fp.tellp() > 0) {
+    report_diagnostic(SCANNER_ERROR, line_num, err_fp.str());
+    err_fp.str("");
+  }
+
+  return tk;
+}
+
+// Errors are written to err_fp, so a scanner thread can hold them for the parser
+Token scanner(std::istream &in_fp, unsigned int &line_num, std::ostream &err_fp) {
   char temp_char;
 
   std::string instance;
@@ -316,7 +333,7 @@ Token scanner(std::ifstream &in_fp, unsigned int &line_num) {
     in_fp.get(temp_char);
 
     if (temp_char == '&') {
-      is_valid_comment = remove_comments(in_fp, line_num, temp_char);
+      is_valid_comment = remove_comments(in_fp, line_num, temp_char, err_fp);
 
       // If there was an error with a comment return an error token
       if (!is_valid_comment) {
@@ -336,7 +353,7 @@ Token scanner(std::ifstream &in_fp, unsigned int &line_num) {
       symbol_col = find_col(temp_char);
 
       if (symbol_col == DEFAULT_ERROR_VALUE) {
-        std::cout << "\nSCANNER ERROR: L" << line_num
+        err_fp << "\nSCANNER ERROR: L" << line_num
           << ": Invalid character: '" << temp_char << "'"
           << std::endl;
 
@@ -379,7 +396,7 @@ Token scanner(std::ifstream &in_fp, unsigned int &line_num) {
       }
       // If it exceeds the limit then return an error
       else {
-        std::cout << "\nSCANNER ERROR: L" << line_num
+        err_fp << "\nSCANNER ERROR: L" << line_num
           << " Invalid length for ident/int: " << instance
           << std::endl;
 
@@ -395,7 +412,7 @@ Token scanner(std::ifstream &in_fp, unsigned int &line_num) {
       }
       // Send error desc
       else if (next_state == DEFAULT_ERROR_VALUE) {
-        std::cout << "\nSCANNER ERROR: L" << line_num
+        err_fp << "\nSCANNER ERROR: L" << line_num
           << " Invalid character " << temp_char
           << " in " << instance
           << std::endl;
@@ -403,7 +420,7 @@ Token scanner(std::ifstream &in_fp, unsigned int &line_num) {
         return Token(TK_ERROR, instance, line_num);
       }
       else if (next_state == CASE_SENSITIVE_ERROR) {
-        std::cout << "\nSCANNER ERROR: L" << line_num
+        err_fp << "\nSCANNER ERROR: L" << line_num
           << ": Invalid identifier start character: '" << temp_char << "'"
           << std::endl;
 
@@ -419,7 +436,7 @@ Token scanner(std::ifstream &in_fp, unsigned int &line_num) {
 
       // If no match then there was an error
       if (search_final_state == final_token_states.end()) {
-        std::cout << "\nSCANNER ERROR: L" << line_num
+        err_fp << "\nSCANNER ERROR: L" << line_num
           << " Invalid token " << instance
           << std::endl;
 
@@ -430,18 +447,44 @@ Token scanner(std::ifstream &in_fp, unsigned int &line_num) {
 
       // Not required if not found, otherwise just set to id/other
       if (search_keywords != reserved_keywords.end()) {
-        return Token(reserved_keywords[instance], instance, line_num);
+        return Token(search_keywords->second, instance, line_num);
       }
 
       /* std::cout << "Final Token Found "; */
       /* std::cout << next_state << " L" << line_num << std::endl; */
 
-      return Token(final_token_states[next_state], instance, line_num);
+      return Token(search_final_state->second, instance, line_num);
     }
   }
 
-  std::cout << "C: " << temp_char << std::endl;
+  err_fp << "C: " << temp_char << std::endl;
 
   // Default error state
   return Token(TK_ERROR, "\nSCANNER ERROR: Critial error found.", line_num);
 }
+
+// Tokens never span lines, so a line can be scanned on its own
+// Used to re-lex only the lines touched by an edit
+std::vector<Token> scan_line(const std::string &line, unsigned int line_num) {
+  std::vector<Token> tokens;
+
+  // Trailing space keeps a comment at the end of the line from being
+  // treated as a dangling comment at the end of the file
+  std::istringstream line_fp(line + "\n ");
+
+  Token tk = scanner(line_fp, line_num);
+
+  while (tk.token_ID != TK_EOF) {
+    tk.line_index = tokens.size();
+    tokens.push_back(tk);
+
+    // Errors end the line, the rest would be eaten by the scanner anyways
+    if (tk.token_ID == TK_ERROR) {
+      break;
+    }
+
+    tk = scanner(line_fp, line_num);
+  }
+
+  return tokens;
+}
@@ -1,12 +1,19 @@
 #ifndef SCANNER_H
 #define SCANNER_H
 
-#include <fstream>
+#include <istream>
+#include <ostream>
+#include <string>
+#include <vector>
 
 #include "token.h"
 
 int find_col(char);
-bool remove_comments(std::ifstream &, unsigned int &, char &);
-Token scanner(std::ifstream &, unsigned int &);
+bool remove_comments(std::istream &, unsigned int &, char &, std::ostream &);
+Token scanner(std::istream &, unsigned int &);
+Token scanner(std::istream &, unsigned int &, std::ostream &);
+
+// Scan a single source line into its tokens
+std::vector<Token> scan_line(const std::string &, unsigned int);
 
 #endif
@@ -0,0 +1,66 @@
+#include <vector>
+
+#include "stream.h"
+#include "optimizer.h"
+#include "options.h"
+#include "parser.h"
+#include "runtime_semantics.h"
+#include "tree_visitor.h"
+
+// Lists every node of a tree
+struct List_Visitor : public Tree_Visitor<List_Visitor> {
+  std::vector<Node *> nodes;
+
+  bool pre_visit(Node *node) {
+    nodes.push_back(node);
+    return true;
+  }
+};
+
+// Kept between statements so the list and stack do not allocate again
+static thread_local List_Visitor listed;
+
+void list_nodes(Node *root) {
+  listed.nodes.clear();
+  listed.visit_iterative(root);
+}
+
+void delete_listed() {
+  for (Node *node: listed.nodes) {
+    delete node;
+  }
+
+  listed.nodes.clear();
+}
+
+// <program> -> <vars> program <block>
+// Each <stat> of <block> is parsed, checked, generated and freed before the next
+void stream_compile(std::istream &source, const std::string &filename) {
+  Node *root = parse_program_head(source);
+
+  begin_stream(root, filename);
+  begin_statement_passes(root);
+
+  Node *stat;
+
+  while ((stat = parse_next_statement()) != nullptr) {
+    // Passes unlink nodes, so they are all listed before any runs
+    list_nodes(stat);
+
+    if (compile_options.tree_passes) {
+      optimize_statement(stat);
+    }
+
+    if (stat != nullptr) {
+      stream_statement(stat);
+    }
+
+    delete_listed();
+  }
+
+  parse_program_end();
+  end_stream();
+
+  list_nodes(root);
+  delete_listed();
+}
@@ -0,0 +1,11 @@
+#ifndef STREAM_H
+#define STREAM_H
+
+#include <istream>
+#include <string>
+
+// Compile a source one top level statement at a time into the target file
+// Memory holds the declarations and the statement being compiled, not the program
+void stream_compile(std::istream &, const std::string &);
+
+#endif
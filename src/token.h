@@ -75,11 +75,16 @@ struct Token {
   std::string token_instance;
   unsigned int line_num;
 
+  // Position of the token within its line
+  // Only filled in when scanning line by line
+  unsigned int line_index;
+
   // Set default state
   Token() {
     this->token_ID = TK_ERROR; // Error by default
     this->token_instance = "";
     this->line_num = 0;
+    this->line_index = 0;
   }
 
   // Set all elements of token in scanner tokens
@@ -87,6 +92,7 @@ struct Token {
     this->token_ID = tk_type;
     this->token_instance = instance;
     this->line_num = current_line;
+    this->line_index = 0;
   }
 };
 
@@ -1,9 +1,13 @@
 #include <iostream>
+#include <iomanip>
 #include <cstdlib>
 #include <fstream>
 #include <set>
+#include <vector>
 
+#include "parser.h"
 #include "tree_traversal.h"
+#include "tree_visitor.h"
 
 // Store the string version of Token_Types
 // For printing purposes
@@ -62,42 +66,344 @@ std::map<Token_Type, std::string> tk_strings = {
   { TK_R_BRACKET      , "Deliminator: Right Square Bracket" },  // ]
 };
 
-// Print pre-order traversal of the given tree
-void print_pre_order(Node *root) {
-  if (root != nullptr) {
-    // Indent by 2x depth of node
-    std::string indent = std::string(root->depth * 2, ' ');
+void append_tokens(std::string &, const Node *);
+
+// Writes each node line to stdout on the way down
+struct Print_Visitor : public Tree_Visitor<Print_Visitor> {
+  bool pre_visit(Node *root) {
+    // Indent by 2x depth of node, padded in place instead of building a string
+    std::cout << std::setw(root->depth * 2) << "";
 
     // Traverse root, display first letter of node strings
-    std::cout << indent << "D"<< root->depth << " - " << root->func_label << ": ";
+    std::cout << "D"<< root->depth << " - " << root->func_label << ": ";
 
-    // Followed by list of token data strings from node
-    print_tokens(root->consumed_tokens);
+    // Followed by what the node kept from its tokens
+    print_tokens(root);
 
-    // Recursively traverse the child nodes and their child nodes
-    print_children(root->children);
+    return true;
   }
+};
+
+// Print pre-order traversal of the given tree
+void print_pre_order(Node *root) {
+  Print_Visitor visitor;
+  visitor.visit(root);
 }
 
 // Print all the nodes inside of vector and their children
-void print_children(std::vector<Node *> words) {
+void print_children(const std::vector<Node *> &words) {
   // Recursively print sub-nodes
   for (Node *node: words) {
-    if (node != nullptr) {
-      print_pre_order(node);
+    print_pre_order(node);
+  }
+}
+
+// Print out the tokens a node kept
+void print_tokens(Node *node) {
+  // Reused so printing does not allocate per node
+  static thread_local std::string tokens;
+
+  tokens.clear();
+  append_tokens(tokens, node);
+
+  // Move on to new line after all tokens have been printed
+  std::cout << tokens << std::endl;
+}
+
+// Flush the dump buffer once it grows past this
+const size_t DUMP_BUFFER_SIZE = 1 << 16;
+
+// Token names by Token_Type, taken from tk_strings once
+// A local static is only built once even with threads dumping at the same time
+const std::string &token_name(Token_Type type) {
+  static const std::vector<std::string> names = []() {
+    std::vector<std::string> table(TK_R_BRACKET + 1);
+
+    for (auto &entry: tk_strings) {
+      table[entry.first] = entry.second;
     }
+
+    return table;
+  }();
+
+  return names[type];
+}
+
+// Append a number without going through a stream
+void append_number(std::string &out, unsigned int value) {
+  char digits[12];
+  int count = 0;
+
+  do {
+    digits[count++] = '0' + value % 10;
+    value /= 10;
+  } while (value != 0);
+
+  while (count > 0) {
+    out += digits[--count];
   }
 }
 
-// Print out all tokens consumed
-void print_tokens(std::vector<Token> tokens) {
-  for (Token tk: tokens) {
-    std::cout << " Token(L" << tk.line_num
-      << " " << tk_strings[tk.token_ID]
-      << ": '" << tk.token_instance << "'"
-      << ") ";
+// Append text inside a JSON or DOT string
+void append_escaped(std::string &out, const std::string &text) {
+  bool plain = true;
+
+  for (char c: text) {
+    if (c == '"' || c == '\\' || static_cast<unsigned char>(c) < 0x20) {
+      plain = false;
+      break;
+    }
   }
 
-  // Move on to new line after all tokens have been printed
-  std::cout << std::endl;
+  // Labels and tokens almost never need escaping
+  if (plain) {
+    out += text;
+    return;
+  }
+
+  for (char c: text) {
+    if (c == '"' || c == '\\') {
+      out += '\\';
+      out += c;
+    }
+    else if (c == '\n') {
+      out += "\\n";
+    }
+    else if (static_cast<unsigned char>(c) < 0x20) {
+      out += ' ';
+    }
+    else {
+      out += c;
+    }
+  }
+}
+
+// One token entry in the text format
+void append_token(std::string &out, unsigned int line, Token_Type type, const std::string &text) {
+  out += " Token(L";
+  append_number(out, line);
+  out += ' ';
+  out += token_name(type);
+  out += ": '";
+  out += text;
+  out += "') ";
+}
+
+// Structural nodes (<program>, <block>, <stats>, <stat>, <if>, <loop>, <out>...) keep no token
+bool keeps_token(const Node *node) {
+  return node->op != TK_EOF;
+}
+
+// Identifier, literal or operator a node kept, as tokens
+void append_tokens(std::string &out, const Node *node) {
+  if (!keeps_token(node)) { return; }
+
+  if (node->op == TK_ID) {
+    append_token(out, node->line, TK_ID, node->symbol);
+
+    // <vars> also keeps its initial value
+    if (node->func_label == "<vars>") {
+      append_token(out, node->line, TK_INT, std::to_string(node->value));
+    }
+  }
+  else if (node->op == TK_INT) {
+    append_token(out, node->line, TK_INT, std::to_string(node->value));
+  }
+  else {
+    append_token(out, node->line, node->op, operator_text(node->op));
+  }
+}
+
+// Same line print_pre_order writes for a node
+void append_text_node(std::string &out, const Node *node) {
+  out.append(node->depth * 2, ' ');
+  out += 'D';
+  append_number(out, node->depth);
+  out += " - ";
+  out += node->func_label;
+  out += ": ";
+
+  append_tokens(out, node);
+
+  out += '\n';
+}
+
+// Opening of a JSON object, children are written after it
+void append_json_node(std::string &out, const Node *node, size_t level) {
+  out.append(level * 2, ' ');
+  out += "{\"label\": \"";
+  append_escaped(out, node->func_label);
+  out += "\", \"depth\": ";
+  append_number(out, node->depth);
+
+  if (keeps_token(node)) {
+    out += ", \"line\": ";
+    append_number(out, node->line);
+    out += ", \"op\": \"";
+    append_escaped(out, token_name(node->op));
+    out += '"';
+  }
+
+  if (!node->symbol.empty()) {
+    out += ", \"symbol\": \"";
+    append_escaped(out, node->symbol);
+    out += '"';
+  }
+
+  if (node->op == TK_INT || node->func_label == "<vars>") {
+    out += ", \"value\": ";
+    out += std::to_string(node->value);
+  }
+
+  out += ", \"children\": [";
+}
+
+// DOT node labelled with its function and token text
+void append_dot_node(std::string &out, const Node *node, unsigned int id) {
+  out += "  n";
+  append_number(out, id);
+  out += " [label=\"";
+  append_escaped(out, node->func_label);
+
+  if (!node->symbol.empty()) {
+    out += "\\n";
+    append_escaped(out, node->symbol);
+
+    if (node->func_label == "<vars>") {
+      out += " = ";
+      out += std::to_string(node->value);
+    }
+  }
+  else if (node->op == TK_INT) {
+    out += "\\n";
+    out += std::to_string(node->value);
+  }
+  else if (keeps_token(node)) {
+    out += "\\n";
+    append_escaped(out, operator_text(node->op));
+  }
+
+  out += "\"];\n";
+}
+
+bool parse_ast_format(const std::string &name, Ast_Format &format) {
+  if (name == "text") {
+    format = AST_TEXT;
+  }
+  else if (name == "json") {
+    format = AST_JSON;
+  }
+  else if (name == "dot") {
+    format = AST_DOT;
+  }
+  else {
+    return false;
+  }
+
+  return true;
+}
+
+// Buffers one format of the dump, flushed in large writes
+class Dump_Visitor : public Tree_Visitor<Dump_Visitor, const Node> {
+  public:
+    Dump_Visitor(Ast_Format format, std::ostream &out_fp) : format(format), out_fp(out_fp) {
+      node_count = 0;
+      out.reserve(DUMP_BUFFER_SIZE + 4096);
+
+      if (format == AST_DOT) {
+        out += "digraph AST {\n  node [shape=box];\n";
+      }
+    }
+
+    bool pre_visit(const Node *node) {
+      if (out.size() >= DUMP_BUFFER_SIZE) {
+        flush();
+      }
+
+      unsigned int id = node_count++;
+
+      if (format == AST_TEXT) {
+        append_text_node(out, node);
+      }
+      else if (format == AST_JSON) {
+        // Separate from the previous sibling
+        if (!wrote_child.empty()) {
+          out += wrote_child.back() ? ",\n" : "\n";
+          wrote_child.back() = true;
+        }
+
+        append_json_node(out, node, wrote_child.size());
+        wrote_child.push_back(false);
+      }
+      else {
+        append_dot_node(out, node, id);
+
+        if (!ids.empty()) {
+          out += "  n";
+          append_number(out, ids.back());
+          out += " -> n";
+          append_number(out, id);
+          out += ";\n";
+        }
+
+        ids.push_back(id);
+      }
+
+      return true;
+    }
+
+    void post_visit(const Node *) {
+      if (format == AST_JSON) {
+        if (wrote_child.back()) {
+          out += '\n';
+          out.append((wrote_child.size() - 1) * 2, ' ');
+        }
+
+        out += "]}";
+        wrote_child.pop_back();
+      }
+      else if (format == AST_DOT) {
+        ids.pop_back();
+      }
+    }
+
+    void finish() {
+      if (format == AST_JSON) {
+        out += '\n';
+      }
+      else if (format == AST_DOT) {
+        out += "}\n";
+      }
+
+      flush();
+      out_fp.flush();
+    }
+
+  private:
+    Ast_Format format;
+    std::ostream &out_fp;
+    std::string out;
+    unsigned int node_count;
+
+    // Open JSON nodes and whether each has written a child yet
+    std::vector<bool> wrote_child;
+
+    // DOT ids of the open nodes
+    std::vector<unsigned int> ids;
+
+    void flush() {
+      out_fp.write(out.data(), out.size());
+      out.clear();
+    }
+};
+
+// Walk with an explicit stack so deep statement chains do not recurse
+void dump_tree(const Node *root, Ast_Format format, std::ostream &out_fp) {
+  if (root == nullptr || format == AST_NONE) {
+    return;
+  }
+
+  Dump_Visitor visitor(format, out_fp);
+  visitor.visit_iterative(root);
+  visitor.finish();
 }
@@ -1,7 +1,11 @@
 #ifndef TREE_TRAVERSAL_H
 #define TREE_TRAVERSAL_H
 
+#include <ostream>
+#include <string>
+
 #include "node.h"
+#include "options.h"
 
 // Functions for traversals
 void print_pre_order(Node *);
@@ -9,7 +13,12 @@ void print_in_order(Node *);
 void print_post_order(Node *);
 
 // Print all node words
-void print_children(std::vector<Node *>);
-void print_tokens(std::vector<Token>);
+void print_children(const std::vector<Node *> &);
+void print_tokens(Node *);
+
+// Buffered dump of the whole tree as indented text, JSON or Graphviz DOT
+// Text matches print_pre_order byte for byte
+bool parse_ast_format(const std::string &, Ast_Format &);
+void dump_tree(const Node *, Ast_Format, std::ostream &);
 
 #endif
@@ -0,0 +1,87 @@
+#ifndef TREE_VISITOR_H
+#define TREE_VISITOR_H
+
+#include <cstddef>
+#include <vector>
+
+#include "node.h"
+
+// Reusable walk over the tree, Derived only defines the hooks it needs
+// Tree_Node is Node or const Node
+// Children are read through references, no child list is ever copied
+template <typename Derived, typename Tree_Node = Node>
+class Tree_Visitor {
+  public:
+    // Called before the children, false skips them
+    bool pre_visit(Tree_Node *) { return true; }
+
+    // Called after the children, even when they were skipped
+    void post_visit(Tree_Node *) {}
+
+    // Recursive walk, Derived may define its own visit to pick child order
+    void visit(Tree_Node *node) {
+      if (node == nullptr) { return; }
+
+      if (self().pre_visit(node)) {
+        visit_children(node);
+      }
+
+      self().post_visit(node);
+    }
+
+    // Every child that is present, in order
+    void visit_children(Tree_Node *node) {
+      for (Tree_Node *child: node->children) {
+        if (child != nullptr) {
+          self().visit(child);
+        }
+      }
+    }
+
+    // Same hooks in the same order with an explicit stack
+    // For deep statement chains, skips any visit Derived defines
+    void visit_iterative(Tree_Node *root) {
+      if (root == nullptr) { return; }
+
+      stack.clear();
+      enter(root);
+
+      while (!stack.empty()) {
+        Frame &frame = stack.back();
+        const auto &children = frame.node->children;
+
+        while (frame.next_child < children.size() && children[frame.next_child] == nullptr) {
+          frame.next_child++;
+        }
+
+        if (frame.next_child < children.size()) {
+          enter(children[frame.next_child++]);
+          continue;
+        }
+
+        Tree_Node *node = frame.node;
+        stack.pop_back();
+
+        self().post_visit(node);
+      }
+    }
+
+  private:
+    struct Frame {
+      Tree_Node *node;
+      size_t next_child;
+    };
+
+    // Kept between walks so repeat walks do not allocate
+    std::vector<Frame> stack;
+
+    void enter(Tree_Node *node) {
+      // Skipped children look like an empty child list
+      size_t first_child = self().pre_visit(node) ? 0 : node->children.size();
+      stack.push_back({ node, first_child });
+    }
+
+    Derived &self() { return *static_cast<Derived *>(this); }
+};
+
+#endif
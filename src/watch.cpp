@@ -0,0 +1,162 @@
+#include <iostream>
+#include <cerrno>
+#include <chrono>
+#include <cstdlib>
+#include <set>
+#include <unordered_map>
+
+#include <dirent.h>
+#include <poll.h>
+#include <sys/inotify.h>
+#include <sys/wait.h>
+#include <unistd.h>
+
+#include "watch.h"
+
+const std::string WATCH_SUFFIX = ".fl2021";
+
+// Quiet time after the last write before compiling, editors save in several writes
+const int WATCH_DEBOUNCE_MS = 100;
+
+// Sources are compiled once written and closed or moved in, new directories are watched too
+const uint32_t WATCH_EVENTS = IN_CLOSE_WRITE | IN_MOVED_TO | IN_CREATE;
+
+static int watch_fd = -1;
+
+// Directory of each watch descriptor
+static std::unordered_map<int, std::string> watched_dirs;
+
+// Watch a directory and every subdirectory under it, skipping hidden ones
+bool add_watches(const std::string &dir) {
+  int wd = inotify_add_watch(watch_fd, dir.c_str(), WATCH_EVENTS);
+
+  if (wd < 0) {
+    std::cout << "Failed to watch directory: " << dir << std::endl;
+    return false;
+  }
+
+  watched_dirs[wd] = dir;
+
+  DIR *listing = opendir(dir.c_str());
+
+  if (listing == nullptr) { return true; }
+
+  while (dirent *entry = readdir(listing)) {
+    std::string name = entry->d_name;
+
+    if (entry->d_type == DT_DIR && name[0] != '.') {
+      add_watches(dir + "/" + name);
+    }
+  }
+
+  closedir(listing);
+
+  return true;
+}
+
+bool is_source(const std::string &name) {
+  return name.size() > WATCH_SUFFIX.size()
+    && name.compare(name.size() - WATCH_SUFFIX.size(), WATCH_SUFFIX.size(), WATCH_SUFFIX) == 0;
+}
+
+// Sources named by the events waiting on the descriptor
+void read_events(std::set<std::string> &changed) {
+  alignas(inotify_event) char buffer[4096];
+
+  ssize_t length = read(watch_fd, buffer, sizeof(buffer));
+
+  for (ssize_t offset = 0; offset < length; ) {
+    const inotify_event *event = (const inotify_event *) (buffer + offset);
+    offset += sizeof(inotify_event) + event->len;
+
+    // Watch removed along with its directory
+    if (event->mask & IN_IGNORED) {
+      watched_dirs.erase(event->wd);
+      continue;
+    }
+
+    auto dir = watched_dirs.find(event->wd);
+
+    if (event->len == 0 || dir == watched_dirs.end()) { continue; }
+
+    std::string name = event->name;
+    std::string path = dir->second + "/" + name;
+
+    if (event->mask & IN_ISDIR) {
+      if (name[0] != '.') {
+        add_watches(path);
+      }
+    }
+    // A created file is compiled when its writer closes it
+    else if (!(event->mask & IN_CREATE) && is_source(name)) {
+      changed.insert(path);
+    }
+  }
+}
+
+double compile_in_child(const std::string &path, Watch_Compile compile, bool &succeeded) {
+  // Anything still buffered would be printed by both processes
+  std::cout << std::flush;
+
+  auto start = std::chrono::steady_clock::now();
+
+  pid_t pid = fork();
+
+  if (pid < 0) {
+    succeeded = false;
+    return 0;
+  }
+
+  if (pid == 0) {
+    compile(path);
+    exit(EXIT_SUCCESS);
+  }
+
+  int status = 0;
+
+  while (waitpid(pid, &status, 0) < 0 && errno == EINTR) {}
+
+  succeeded = WIFEXITED(status) && WEXITSTATUS(status) == EXIT_SUCCESS;
+
+  return std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count();
+}
+
+void watch_directory(const std::string &dir, Watch_Compile compile) {
+  watch_fd = inotify_init1(IN_CLOEXEC);
+
+  if (watch_fd < 0 || !add_watches(dir)) {
+    std::cout << "Failed to start watching. Exiting.\n" << std::endl;
+    exit(EXIT_FAILURE);
+  }
+
+  std::cout << "Watching " << dir << " for changes to *" << WATCH_SUFFIX << " (CTRL-C to end)" << std::endl;
+
+  std::set<std::string> changed;
+  pollfd poll_fd = { watch_fd, POLLIN, 0 };
+
+  while (true) {
+    // Wait for a first change, then for the writes to go quiet
+    int ready = poll(&poll_fd, 1, changed.empty() ? -1 : WATCH_DEBOUNCE_MS);
+
+    if (ready < 0) {
+      if (errno == EINTR) { continue; }
+      break;
+    }
+
+    if (ready > 0) {
+      read_events(changed);
+      continue;
+    }
+
+    for (const std::string &path: changed) {
+      bool succeeded;
+      double ms = compile_in_child(path, compile, succeeded);
+
+      std::cout << (succeeded ? "Compiled " : "Failed ") << path << " in " << ms << " ms" << std::endl;
+    }
+
+    changed.clear();
+  }
+
+  close(watch_fd);
+}
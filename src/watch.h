@@ -0,0 +1,17 @@
+#ifndef WATCH_H
+#define WATCH_H
+
+#include <string>
+
+// Compiles one saved source, given its path, may exit on errors
+typedef void (*Watch_Compile)(const std::string &);
+
+// Watch a directory and its subdirectories with inotify until interrupted
+// Bursts of writes are let settle, then each changed .fl2021 is compiled once
+void watch_directory(const std::string &, Watch_Compile);
+
+// Compile a source in a forked copy of this process, milliseconds taken
+// The copy starts with everything already loaded, and its errors only end the copy
+double compile_in_child(const std::string &, Watch_Compile, bool &);
+
+#endif